@@ -0,0 +1,203 @@
+/**
+ * @file    bench.c
+ * @brief   Timings for bigint.c over a sweep of operand sizes
+ *
+ * Each operation runs on operands of 1, 10, 100, ... limbs for at least
+ * --min-time seconds, and the mean time per call is
+ * reported as CSV (the default) or JSON, one record per operation and
+ * size, in the same shape as bench.py so the results can be compared.
+ * Once a single call of an operation takes longer than --budget seconds,
+ * its larger sizes are skipped.
+ *
+ * Usage: bench_bigint [--format csv|json] [--max LIMBS] [--ops NAME,...]
+ *                     [--min-time SECONDS] [--budget SECONDS] [--threads N]
+ */
+#include <time.h>
+
+#define AS_LIB
+#include "bigint.c"
+
+/* Fixed operands for one size; every operation writes only r, q and s. */
+struct Operands {
+	KrkLong a, b;   /* n limbs each */
+	KrkLong wide;   /* 2n limbs, the dividend for divmod */
+	KrkLong r, q;
+	char * decimal; /* a in base 10, for parse */
+	char * s;
+};
+
+/*
+ * (2**bits - 1) // divisor, the same fixed patterns bench.py builds, so
+ * every implementation times the same values.
+ */
+static void _pattern_long(KrkLong * num, size_t bits, int divisor) {
+	KrkLong one, d, rem;
+	krk_long_init_si(&one, 1);
+	krk_long_init_si(&d, divisor);
+	krk_long_init_many(num, &rem, NULL);
+	krk_long_lshift(num, &one, bits);
+	krk_long_sub(num, num, &one);
+	krk_long_div_rem(num, &rem, num, &d);
+	krk_long_clear_many(&one, &d, &rem, NULL);
+}
+
+static void _bench_add(struct Operands * o) { krk_long_add(&o->r, &o->a, &o->b); }
+static void _bench_sub(struct Operands * o) { krk_long_sub(&o->r, &o->a, &o->b); }
+static void _bench_mul(struct Operands * o) { krk_long_mul(&o->r, &o->a, &o->b); }
+static void _bench_sqr(struct Operands * o) { krk_long_sqr(&o->r, &o->a); }
+static void _bench_divmod(struct Operands * o) { krk_long_div_rem(&o->q, &o->r, &o->wide, &o->b); }
+static void _bench_lshift(struct Operands * o) { krk_long_lshift(&o->r, &o->a, 77); }
+static void _bench_rshift(struct Operands * o) { krk_long_rshift(&o->r, &o->a, 77); }
+static void _bench_and(struct Operands * o) { krk_long_and(&o->r, &o->a, &o->b); }
+static void _bench_or(struct Operands * o) { krk_long_or(&o->r, &o->a, &o->b); }
+static void _bench_xor(struct Operands * o) { krk_long_xor(&o->r, &o->a, &o->b); }
+
+static void _bench_to_str(struct Operands * o) {
+	size_t size;
+	free(o->s);
+	o->s = krk_long_to_str(&o->a, 10, "", &size);
+}
+
+static void _bench_parse(struct Operands * o) {
+	/* krk_long_parse_string initializes its output */
+	krk_long_clear(&o->r);
+	krk_long_parse_string(o->decimal, &o->r);
+}
+
+static const struct {
+	const char * name;
+	void (*run)(struct Operands *);
+} _benchmarks[] = {
+	{ "add", _bench_add },
+	{ "sub", _bench_sub },
+	{ "mul", _bench_mul },
+	{ "sqr", _bench_sqr },
+	{ "divmod", _bench_divmod },
+	{ "lshift", _bench_lshift },
+	{ "rshift", _bench_rshift },
+	{ "and", _bench_and },
+	{ "or", _bench_or },
+	{ "xor", _bench_xor },
+	{ "to_str", _bench_to_str },
+	{ "parse", _bench_parse },
+};
+
+#define BENCHMARKS (sizeof(_benchmarks) / sizeof(*_benchmarks))
+
+static double _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Whether name is one of the comma-separated names in list, or list is NULL. */
+static int _selected(const char * list, const char * name) {
+	if (!list) return 1;
+	size_t len = strlen(name);
+	for (const char * c = list; c; c = strchr(c, ',')) {
+		if (*c == ',') c++;
+		if (!strncmp(c, name, len) && (c[len] == ',' || c[len] == '\0')) return 1;
+	}
+	return 0;
+}
+
+static void _usage(const char * argv0) {
+	fprintf(stderr, "usage: %s [--format csv|json] [--max LIMBS] [--ops NAME,...] [--min-time SECONDS] [--budget SECONDS] [--threads N]\n", argv0);
+}
+
+int main(int argc, char * argv[]) {
+	int json = 0;
+	size_t max = 1000000;
+	double min_time = 0.2;
+	double budget = 1.0;
+	const char * ops = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 == argc) {
+			_usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "--format")) {
+			json = !strcmp(argv[++i], "json");
+		} else if (!strcmp(argv[i], "--max")) {
+			max = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--ops")) {
+			ops = argv[++i];
+		} else if (!strcmp(argv[i], "--min-time")) {
+			min_time = strtod(argv[++i], NULL);
+		} else if (!strcmp(argv[i], "--budget")) {
+			budget = strtod(argv[++i], NULL);
+		} else if (!strcmp(argv[i], "--threads")) {
+			if (krk_long_set_threads(atoi(argv[++i]))) fprintf(stderr, "%s: threads are not available\n", argv[0]);
+		} else {
+			_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (json) printf("[\n");
+	else printf("impl,op,limbs,bits,iterations,seconds\n");
+
+	int active[BENCHMARKS], remaining = 0;
+	for (size_t k = 0; k < BENCHMARKS; ++k) remaining += active[k] = _selected(ops, _benchmarks[k].name);
+
+	int first = 1;
+	for (size_t limbs = 1; limbs <= max && remaining; limbs *= 10) {
+		struct Operands o;
+		_pattern_long(&o.a, limbs * DIGIT_SHIFT, 7);
+		_pattern_long(&o.b, limbs * DIGIT_SHIFT, 11);
+		_pattern_long(&o.wide, 2 * limbs * DIGIT_SHIFT, 13);
+		krk_long_init_many(&o.r, &o.q, NULL);
+		o.decimal = NULL;
+		o.s = NULL;
+
+		for (size_t k = 0; k < BENCHMARKS; ++k) {
+			if (!active[k]) continue;
+			if (_benchmarks[k].run == _bench_parse && !o.decimal) {
+				size_t size;
+				o.decimal = krk_long_to_str(&o.a, 10, "", &size);
+			}
+
+			/*
+			 * Run once to warm the pool and caches, then in doubling batches.
+			 * A first call over budget is the only one, and the last size.
+			 */
+			double start = _now();
+			_benchmarks[k].run(&o);
+			double elapsed = _now() - start;
+			size_t iterations = 1;
+
+			if (elapsed > budget) {
+				active[k] = 0;
+				remaining--;
+			} else {
+				size_t batch = 1;
+				iterations = 0;
+				start = _now();
+				do {
+					for (size_t i = 0; i < batch; ++i) _benchmarks[k].run(&o);
+					iterations += batch;
+					batch *= 2;
+					elapsed = _now() - start;
+				} while (elapsed < min_time);
+			}
+
+			double seconds = elapsed / iterations;
+			if (json) {
+				printf("%s  {\"impl\": \"c\", \"op\": \"%s\", \"limbs\": %zu, \"bits\": %zu, \"iterations\": %zu, \"seconds\": %.9g}",
+					first ? "" : ",\n", _benchmarks[k].name, limbs, limbs * DIGIT_SHIFT, iterations, seconds);
+			} else {
+				printf("c,%s,%zu,%zu,%zu,%.9g\n", _benchmarks[k].name, limbs, limbs * DIGIT_SHIFT, iterations, seconds);
+			}
+			first = 0;
+			fflush(stdout);
+		}
+
+		krk_long_clear_many(&o.a, &o.b, &o.wide, &o.r, &o.q, NULL);
+		free(o.decimal);
+		free(o.s);
+	}
+
+	if (json) printf("\n]\n");
+	krk_long_set_threads(1);
+	return 0;
+}
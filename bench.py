@@ -0,0 +1,118 @@
+# Timings for the bigint module's long under Kuroko, or for int under
+# CPython, over the same sweep of sizes as bench.c. Output is CSV (the
+# default) or JSON with the same fields, where 'bits' is the size to
+# compare on and 'limbs' counts digits of the module's bits_per_digit.
+# CPython has no such digits, so it sizes operands as a build with
+# --bits-per-digit (63 unless given; 31 for 32-bit digits) would. Once a
+# single call of an operation takes longer than --budget seconds, its
+# larger sizes are skipped.
+#
+#   kuroko bench.py [--format csv|json] [--max LIMBS] [--ops NAME,...]
+#                   [--min-time SECONDS] [--budget SECONDS] [--threads N]
+#   python3 bench.py [same options] [--bits-per-digit N]
+
+import time
+
+def operands(thing, bits):
+    # Fixed patterns rather than random ones, built the same way in bench.c,
+    # so every implementation times the same values
+    one = thing(1)
+    a = ((one << bits) - 1) // 7
+    b = ((one << bits) - 1) // 11
+    wide = ((one << (2 * bits)) - 1) // 13
+    return a, b, wide
+
+def benchmarks(thing, a, b, wide, decimal):
+    return [
+        ('add', lambda: a + b),
+        ('sub', lambda: a - b),
+        ('mul', lambda: a * b),
+        ('sqr', lambda: a * a),
+        ('divmod', lambda: (wide // b, wide % b)),
+        ('lshift', lambda: a << 77),
+        ('rshift', lambda: a >> 77),
+        ('and', lambda: a & b),
+        ('or', lambda: a | b),
+        ('xor', lambda: a ^ b),
+        ('to_str', lambda: str(a)),
+        ('parse', lambda: thing(decimal)),
+    ]
+
+def run(impl, thing, bits_per_digit, args):
+    fmt = args.get('--format', 'csv')
+    most = int(args.get('--max', '1000000'))
+    min_time = float(args.get('--min-time', '0.2'))
+    budget = float(args.get('--budget', '1'))
+    if '--ops' in args:
+        wanted = args['--ops'].split(',')
+    else:
+        wanted = [name for name, func in benchmarks(thing, 0, 0, 0, '')]
+
+    if fmt == 'json':
+        print('[')
+    else:
+        print('impl,op,limbs,bits,iterations,seconds')
+
+    first = True
+    limbs = 1
+    while limbs <= most and wanted:
+        bits = limbs * bits_per_digit
+        a, b, wide = operands(thing, bits)
+        decimal = str(a) if 'parse' in wanted else None
+        for name, func in benchmarks(thing, a, b, wide, decimal):
+            if name not in wanted:
+                continue
+            # Run once to warm up, then in doubling batches; a first call
+            # over budget is the only one, and the last size
+            start = time.time()
+            func()
+            elapsed = time.time() - start
+            iterations = 1
+            if elapsed > budget:
+                wanted = [other for other in wanted if other != name]
+            else:
+                iterations = 0
+                batch = 1
+                start = time.time()
+                elapsed = 0
+                while elapsed < min_time:
+                    for i in range(batch):
+                        func()
+                    iterations += batch
+                    batch *= 2
+                    elapsed = time.time() - start
+            seconds = elapsed / iterations
+            if fmt == 'json':
+                print(('' if first else ',\n') + '  {"impl": "' + impl + '", "op": "' + name + '", "limbs": ' + str(limbs) +
+                      ', "bits": ' + str(bits) + ', "iterations": ' + str(iterations) + ', "seconds": ' + str(seconds) + '}', end='')
+            else:
+                print(impl + ',' + name + ',' + str(limbs) + ',' + str(bits) + ',' + str(iterations) + ',' + str(seconds))
+            first = False
+        limbs *= 10
+
+    if fmt == 'json':
+        print('\n]')
+
+if __name__ == '__main__':
+    if 'complex' in dir(__builtins__):
+        import sys
+        if hasattr(sys, 'set_int_max_str_digits'):
+            sys.set_int_max_str_digits(0)
+        argv = sys.argv
+        impl = 'cpython'
+        thing = int
+        bits_per_digit = None
+    else:
+        import kuroko
+        from bigint import long, threads, bits_per_digit
+        argv = kuroko.argv
+        impl = 'kuroko'
+        thing = long
+    args = {}
+    for i in range(1, len(argv) - 1, 2):
+        args[argv[i]] = argv[i + 1]
+    if impl == 'kuroko' and '--threads' in args:
+        threads(int(args['--threads']))
+    if bits_per_digit is None:
+        bits_per_digit = int(args.get('--bits-per-digit', '63'))
+    run(impl, thing, bits_per_digit, args)
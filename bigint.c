@@ -5,20 +5,402 @@
 #include <stdarg.h>
 #include <string.h>
 
+/*
+ * Digits are DIGIT_SHIFT bits wide, stored in a digit_t with one bit to
+ * spare so that two digits and a carry can be summed without overflow.
+ * Products and quotients are computed in the double-width ddigit_t.
+ * Where the compiler offers 128-bit integers, 63-bit digits are used;
+ * build with KRK_LONG_DIGIT_BITS=32 for the 31-bit layout.
+ */
+#ifndef KRK_LONG_DIGIT_BITS
+# ifdef __SIZEOF_INT128__
+#  define KRK_LONG_DIGIT_BITS 64
+# else
+#  define KRK_LONG_DIGIT_BITS 32
+# endif
+#endif
+
+#if KRK_LONG_DIGIT_BITS == 64
+typedef uint64_t digit_t;
+typedef unsigned __int128 ddigit_t;
+typedef __int128 sddigit_t;
+#define DIGIT_SHIFT 63
+#define DIGIT_MAX   0x7FFFFFFFFFFFFFFFULL
+#else
+typedef uint32_t digit_t;
+typedef uint64_t ddigit_t;
+typedef int64_t sddigit_t;
 #define DIGIT_SHIFT 31
 #define DIGIT_MAX   0x7FFFFFFF
+#endif
+
+/**
+ * Divide a double-width value by a digit, for callers that know the
+ * quotient fits in a digit_t. Compilers turn a 128-bit division into a
+ * library call, so x86-64 uses the hardware's 128-by-64 divide directly.
+ */
+static inline digit_t _div_wide(ddigit_t num, digit_t d, digit_t * rem) {
+#if KRK_LONG_DIGIT_BITS == 64 && defined(__x86_64__) && defined(__GNUC__)
+	digit_t q, r;
+	__asm__ ("divq %4" : "=a"(q), "=d"(r) : "a"((digit_t)num), "d"((digit_t)(num >> 64)), "rm"(d));
+	*rem = r;
+	return q;
+#else
+	*rem = num % d;
+	return num / d;
+#endif
+}
+
+/*
+ * Values up to KRK_LONG_INLINE_DIGITS digits wide keep their digits
+ * inside the struct itself, so small numbers never touch the heap.
+ * 'digits' then points at 'inline_digits', so a KrkLong that owns
+ * inline digits must not be copied by assignment; use _swap or
+ * krk_long_move instead.
+ *
+ * 'capacity' is how many digits 'digits' has room for, which may be
+ * more than the current width. Growing an existing buffer over-allocates
+ * geometrically and shrinking never gives memory back on its own; see
+ * krk_long_reserve and krk_long_shrink_to_fit.
+ */
+#ifndef KRK_LONG_INLINE_DIGITS
+#define KRK_LONG_INLINE_DIGITS (128 / KRK_LONG_DIGIT_BITS)
+#endif
 
 struct BigInteger {
 	ssize_t    width;
-	uint32_t *digits;
+	digit_t *digits;
+	size_t     capacity;
+	digit_t  inline_digits[KRK_LONG_INLINE_DIGITS];
 };
 
 typedef struct BigInteger KrkLong;
 
+/*
+ * Heap digit buffers come from a pool of per-thread free lists, one per
+ * size class. Class k holds buffers of (KRK_LONG_POOL_MIN << k) digits,
+ * and each list keeps at most KRK_LONG_POOL_DEPTH buffers; anything
+ * wider than the largest class goes straight to the allocator.
+ *
+ * The allocator underneath can be replaced with krk_long_set_allocator,
+ * which gets the size of every buffer it frees so it can do accounting.
+ * A thread that leaves anything cached drains it when it exits, where
+ * pthreads are available, so nothing is stranded on threads that end.
+ */
+#ifndef KRK_LONG_POOL_CLASSES
+#define KRK_LONG_POOL_CLASSES 10
+#endif
+#ifndef KRK_LONG_POOL_DEPTH
+#define KRK_LONG_POOL_DEPTH 32
+#endif
+#define KRK_LONG_POOL_MIN (KRK_LONG_INLINE_DIGITS * 2)
+
+#if defined(__GNUC__)
+#define KRK_LONG_THREAD_LOCAL __thread
+#else
+#define KRK_LONG_THREAD_LOCAL
+#endif
+
+#if !defined(KRK_DISABLE_THREADS) && defined(__unix__)
+#define KRK_LONG_POOL_EXIT
+#include <pthread.h>
+#endif
+
+struct KrkLongAllocator {
+	void * (*alloc)(size_t size);
+	void   (*free)(void * ptr, size_t size);
+};
+
+struct KrkLongPoolStats {
+	size_t hits;     /* allocations served from a free list */
+	size_t misses;   /* allocations that went to the allocator */
+	size_t returned; /* frees kept on a free list */
+	size_t released; /* frees passed back to the allocator */
+	size_t cached;   /* bytes currently held on free lists */
+};
+
+struct PoolClass {
+	void * head;
+	size_t count;
+};
+
+static void * _default_alloc(size_t size) {
+	return malloc(size);
+}
+
+static void _default_free(void * ptr, size_t size) {
+	free(ptr);
+}
+
+static struct KrkLongAllocator _allocator = { _default_alloc, _default_free };
+static KRK_LONG_THREAD_LOCAL struct PoolClass _pool[KRK_LONG_POOL_CLASSES];
+static KRK_LONG_THREAD_LOCAL struct KrkLongPoolStats _pool_stats;
+
+/*
+ * Optional instrumentation, compiled in with KRK_LONG_STATS and absent
+ * otherwise. Each public operation records its calls, limbs (of its
+ * widest operand, or of the result when parsing) and time, binned into a
+ * histogram of latency by size: size buckets of under 10, 100, ... limbs
+ * and latency buckets of under 1us, 10us, ... Only the outermost call on
+ * a thread is recorded, so the multiplications inside a pow count as
+ * pow. Tier counters record every choice of algorithm, however deeply
+ * nested, and the allocation counters every buffer that reaches the
+ * allocator; pool hits are in krk_long_pool_stats instead. Counters are
+ * shared by all threads.
+ */
+#ifdef KRK_LONG_STATS
+#include <time.h>
+
+#define KRK_LONG_STAT_SIZES     7
+#define KRK_LONG_STAT_LATENCIES 8
+
+/* module_bigint.c names these in the same order */
+enum {
+	STAT_ADD, STAT_SUB, STAT_MUL, STAT_SQR, STAT_DIVMOD, STAT_LSHIFT, STAT_RSHIFT, STAT_AND, STAT_OR, STAT_XOR,
+	STAT_POW, STAT_MODULUS, STAT_POWMOD, STAT_GCD, STAT_ROOT, STAT_TO_STR, STAT_PARSE,
+	STAT_OPERATIONS
+};
+
+enum {
+	TIER_MUL_BASECASE, TIER_MUL_KARATSUBA, TIER_MUL_TOOM3, TIER_MUL_TOOM4, TIER_MUL_NTT, TIER_MUL_UNBALANCED,
+	TIER_SQR_BASECASE, TIER_SQR_KARATSUBA, TIER_SQR_TOOM3, TIER_SQR_TOOM4, TIER_SQR_NTT,
+	TIER_DIV_SMALL, TIER_DIV_KNUTH, TIER_DIV_BARRETT,
+	TIER_STR_POW2, TIER_STR_RECURSIVE, TIER_PARSE_POW2, TIER_PARSE_RECURSIVE,
+	TIER_FORK,
+	STAT_TIERS
+};
+
+struct KrkLongStats {
+	size_t calls[STAT_OPERATIONS];
+	size_t limbs[STAT_OPERATIONS];
+	size_t nanoseconds[STAT_OPERATIONS];
+	size_t histogram[STAT_OPERATIONS][KRK_LONG_STAT_SIZES][KRK_LONG_STAT_LATENCIES];
+	size_t tiers[STAT_TIERS];
+	size_t allocs;          /* buffers from the allocator */
+	size_t frees;           /* buffers given back to it */
+	size_t grows;           /* numbers moved to a wider buffer */
+	size_t bytes_allocated;
+	size_t bytes_freed;
+};
+
+static struct KrkLongStats _stats;
+static KRK_LONG_THREAD_LOCAL int _stat_depth;
+
+struct StatTimer {
+	int op;
+	size_t limbs;
+	struct timespec start;
+};
+
+static struct StatTimer _stat_begin(int op, size_t limbs) {
+	struct StatTimer timer = { op, limbs };
+	if (_stat_depth++ == 0) clock_gettime(CLOCK_MONOTONIC, &timer.start);
+	return timer;
+}
+
+static void _stat_end(struct StatTimer * timer) {
+	if (--_stat_depth) return;
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	size_t ns = (end.tv_sec - timer->start.tv_sec) * 1000000000 + end.tv_nsec - timer->start.tv_nsec;
+
+	int size = 0, latency = 0;
+	for (size_t n = timer->limbs / 10; n && size < KRK_LONG_STAT_SIZES - 1; n /= 10) size++;
+	for (size_t t = ns / 1000; t && latency < KRK_LONG_STAT_LATENCIES - 1; t /= 10) latency++;
+
+	__atomic_add_fetch(&_stats.calls[timer->op], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&_stats.limbs[timer->op], timer->limbs, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&_stats.nanoseconds[timer->op], ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&_stats.histogram[timer->op][size][latency], 1, __ATOMIC_RELAXED);
+}
+
+static size_t _stat_width(const KrkLong * a, const KrkLong * b) {
+	size_t x = a->width < 0 ? -a->width : a->width;
+	size_t y = !b ? 0 : b->width < 0 ? -b->width : b->width;
+	return x > y ? x : y;
+}
+
+/**
+ * A snapshot of the counters. Counters move independently, so one taken
+ * while other threads are working may be slightly inconsistent.
+ */
+static void krk_long_stats(struct KrkLongStats * out) {
+	size_t * from = (size_t *)&_stats, * to = (size_t *)out;
+	for (size_t i = 0; i < sizeof(_stats) / sizeof(size_t); ++i) to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Zero every counter. Not to be called while other threads are working.
+ */
+static void krk_long_reset_stats(void) {
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+#define STAT_CALL(op, limbs) struct StatTimer _stat_timer __attribute__((cleanup(_stat_end))) = _stat_begin(op, limbs)
+#define STAT_LIMBS(n) (_stat_timer.limbs = (n))
+#define STAT_COUNT(field, n) __atomic_add_fetch(&_stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_TIER(tier) STAT_COUNT(tiers[tier], 1)
+#else
+#define STAT_CALL(op, limbs) do { } while (0)
+#define STAT_LIMBS(n) do { } while (0)
+#define STAT_COUNT(field, n) do { } while (0)
+#define STAT_TIER(tier) do { } while (0)
+#endif
+
+/*
+ * Set on the multiplication pool's worker threads, which use malloc
+ * directly instead of the installed allocator; see krk_long_set_threads.
+ */
+static KRK_LONG_THREAD_LOCAL int _worker_heap;
+
+static void * _heap_alloc(size_t size) {
+	STAT_COUNT(allocs, 1);
+	STAT_COUNT(bytes_allocated, size);
+	return _worker_heap ? _default_alloc(size) : _allocator.alloc(size);
+}
+
+static void _heap_free(void * ptr, size_t size) {
+	STAT_COUNT(frees, 1);
+	STAT_COUNT(bytes_freed, size);
+	if (_worker_heap) _default_free(ptr, size);
+	else _allocator.free(ptr, size);
+}
+
+static void krk_long_pool_drain(void);
+
+#ifdef KRK_LONG_POOL_EXIT
+static pthread_key_t _pool_key;
+static pthread_once_t _pool_key_once = PTHREAD_ONCE_INIT;
+static KRK_LONG_THREAD_LOCAL int _pool_registered;
+
+static void _pool_exit(void * unused) {
+	_pool_registered = 0;
+	krk_long_pool_drain();
+}
+
+static void _pool_key_init(void) {
+	pthread_key_create(&_pool_key, _pool_exit);
+}
+#endif
+
+/**
+ * Arrange for the calling thread's pool to be drained when it exits;
+ * called whenever something is cached on it.
+ */
+static inline void _pool_register(void) {
+#ifdef KRK_LONG_POOL_EXIT
+	if (_pool_registered) return;
+	_pool_registered = 1;
+	pthread_once(&_pool_key_once, _pool_key_init);
+	/* Destructors only run for keys with a value */
+	pthread_setspecific(_pool_key, &_pool_registered);
+#endif
+}
+
+/**
+ * Size class for a buffer of count digits, or -1 if it is too wide to pool.
+ */
+static int _pool_class(size_t count) {
+	size_t size = KRK_LONG_POOL_MIN;
+	for (int i = 0; i < KRK_LONG_POOL_CLASSES; ++i, size <<= 1) {
+		if (count <= size) return i;
+	}
+	return -1;
+}
+
+static digit_t * _limb_alloc(size_t count, size_t * capacity) {
+	int cls = _pool_class(count);
+	if (cls < 0) {
+		*capacity = count;
+		return _heap_alloc(sizeof(digit_t) * count);
+	}
+
+	*capacity = (size_t)KRK_LONG_POOL_MIN << cls;
+	struct PoolClass * pool = &_pool[cls];
+	if (pool->head) {
+		void * out = pool->head;
+		pool->head = *(void**)out;
+		pool->count--;
+		_pool_stats.hits++;
+		_pool_stats.cached -= sizeof(digit_t) * *capacity;
+		return out;
+	}
+
+	_pool_stats.misses++;
+	return _heap_alloc(sizeof(digit_t) * *capacity);
+}
+
+static void _limb_free(digit_t * digits, size_t capacity) {
+	int cls = _pool_class(capacity);
+	if (cls >= 0 && _pool[cls].count < KRK_LONG_POOL_DEPTH) {
+		_pool_register();
+		*(void**)digits = _pool[cls].head;
+		_pool[cls].head = digits;
+		_pool[cls].count++;
+		_pool_stats.returned++;
+		_pool_stats.cached += sizeof(digit_t) * capacity;
+		return;
+	}
+
+	_pool_stats.released++;
+	_heap_free(digits, sizeof(digit_t) * capacity);
+}
+
+static void _ntt_release(void);
+
+/**
+ * Give every buffer on this thread's free lists, and its cached NTT
+ * twiddle factors, back to the allocator.
+ */
+static void krk_long_pool_drain(void) {
+	for (int i = 0; i < KRK_LONG_POOL_CLASSES; ++i) {
+		size_t capacity = (size_t)KRK_LONG_POOL_MIN << i;
+		while (_pool[i].head) {
+			void * next = *(void**)_pool[i].head;
+			_heap_free(_pool[i].head, sizeof(digit_t) * capacity);
+			_pool[i].head = next;
+		}
+		_pool[i].count = 0;
+	}
+	_pool_stats.cached = 0;
+	_ntt_release();
+}
+
+/**
+ * Statistics for the calling thread's pool.
+ */
+static void krk_long_pool_stats(struct KrkLongPoolStats * out) {
+	*out = _pool_stats;
+}
+
+/**
+ * Replace the allocator behind the pool. This should happen before any
+ * digit buffers are allocated; the calling thread's pool is drained to
+ * the old allocator first.
+ */
+static void krk_long_set_allocator(const struct KrkLongAllocator * allocator) {
+	krk_long_pool_drain();
+	_allocator = *allocator;
+}
+
+/**
+ * Point an empty num at fresh storage for count digits.
+ */
+static void _alloc_digits(KrkLong * num, size_t count) {
+	if (count <= KRK_LONG_INLINE_DIGITS) {
+		num->digits = num->inline_digits;
+		num->capacity = KRK_LONG_INLINE_DIGITS;
+	} else {
+		num->digits = _limb_alloc(count, &num->capacity);
+	}
+}
+
 static int krk_long_init_si(KrkLong * num, int64_t val) {
 	if (val == 0) {
 		num->width = 0;
 		num->digits = NULL;
+		num->capacity = 0;
 		return 0;
 	}
 
@@ -27,7 +409,7 @@ static int krk_long_init_si(KrkLong * num, int64_t val) {
 
 	if (abs <= DIGIT_MAX) {
 		num->width = sign;
-		num->digits = malloc(sizeof(uint32_t));
+		_alloc_digits(num, 1);
 		num->digits[0] = abs;
 		return 0;
 	}
@@ -41,7 +423,7 @@ static int krk_long_init_si(KrkLong * num, int64_t val) {
 	}
 
 	num->width = cnt * sign;
-	num->digits = malloc(sizeof(uint32_t) * cnt);
+	_alloc_digits(num, cnt);
 
 	for (int64_t i = 0; i < cnt; ++i) {
 		num->digits[i] = (abs & DIGIT_MAX);
@@ -52,9 +434,10 @@ static int krk_long_init_si(KrkLong * num, int64_t val) {
 }
 
 static int krk_long_clear(KrkLong * num) {
-	if (num->digits) free(num->digits);
+	if (num->digits && num->digits != num->inline_digits) _limb_free(num->digits, num->capacity);
 	num->width = 0;
 	num->digits = NULL;
+	num->capacity = 0;
 	return 0;
 }
 
@@ -89,52 +472,466 @@ static int krk_long_init_many(KrkLong *a, ...) {
 static int krk_long_init_copy(KrkLong * out, const KrkLong * in) {
 	size_t abs_width = in->width < 0 ? -in->width : in->width;
 	out->width = in->width;
-	out->digits = out->width ? malloc(sizeof(uint32_t) * abs_width) : NULL;
+	out->digits = NULL;
+	out->capacity = 0;
+	if (abs_width) _alloc_digits(out, abs_width);
 	for (size_t i = 0; i < abs_width; ++i) {
 		out->digits[i] = in->digits[i];
 	}
 	return 0;
 }
 
-static int krk_long_resize(KrkLong * num, ssize_t newdigits) {
-	if (newdigits == 0) {
+/**
+ * Make room for at least 'count' digits without changing the value.
+ */
+static int krk_long_reserve(KrkLong * num, size_t count) {
+	if (count <= num->capacity) return 0;
+
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+
+	if (!num->digits) {
+		_alloc_digits(num, count);
+		return 0;
+	}
+
+	STAT_COUNT(grows, 1);
+	size_t capacity;
+	digit_t * digits = _limb_alloc(count, &capacity);
+	memcpy(digits, num->digits, sizeof(digit_t) * abs_width);
+	if (num->digits != num->inline_digits) _limb_free(num->digits, num->capacity);
+	num->digits = digits;
+	num->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * Release any storage beyond what the current width needs.
+ */
+static int krk_long_shrink_to_fit(KrkLong * num) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+
+	if (abs_width == 0) {
 		krk_long_clear(num);
+	} else if (num->digits == num->inline_digits) {
 		return 0;
+	} else if (abs_width <= KRK_LONG_INLINE_DIGITS) {
+		memcpy(num->inline_digits, num->digits, sizeof(digit_t) * abs_width);
+		_limb_free(num->digits, num->capacity);
+		num->digits = num->inline_digits;
+		num->capacity = KRK_LONG_INLINE_DIGITS;
+	} else {
+		int cls = _pool_class(abs_width);
+		size_t fit = cls < 0 ? abs_width : (size_t)KRK_LONG_POOL_MIN << cls;
+		if (fit >= num->capacity) return 0;
+		size_t capacity;
+		digit_t * digits = _limb_alloc(abs_width, &capacity);
+		memcpy(digits, num->digits, sizeof(digit_t) * abs_width);
+		_limb_free(num->digits, num->capacity);
+		num->digits = digits;
+		num->capacity = capacity;
 	}
 
+	return 0;
+}
+
+/**
+ * Set the width (and sign) of num, keeping existing digits. New digits
+ * are left uninitialized. Existing buffers grow by at least half again.
+ */
+static int krk_long_resize(KrkLong * num, ssize_t newdigits) {
 	size_t abs = newdigits < 0 ? -newdigits : newdigits;
-	size_t eabs = num->width < 0 ? -num->width : num->width;
-	if (num->width == 0) {
-		num->digits = malloc(sizeof(uint32_t) * newdigits);
-	} else if (eabs < abs) {
-		num->digits = realloc(num->digits, sizeof(uint32_t) * newdigits);
+
+	if (abs > num->capacity) {
+		size_t capacity = num->capacity + num->capacity / 2;
+		krk_long_reserve(num, capacity > abs ? capacity : abs);
 	}
 
 	num->width = newdigits;
 	return 0;
 }
 
+/**
+ * Copy the value of 'in' into the already-initialized 'out', reusing
+ * its buffer when it is large enough.
+ */
+static int krk_long_set(KrkLong * out, const KrkLong * in) {
+	if (out == in) return 0;
+	size_t abs_width = in->width < 0 ? -in->width : in->width;
+	krk_long_resize(out, abs_width);
+	if (abs_width) memcpy(out->digits, in->digits, sizeof(digit_t) * abs_width);
+	out->width = in->width;
+	return 0;
+}
+
 static int krk_long_set_sign(KrkLong * num, int sign) {
 	num->width = num->width < 0 ? (-num->width) * sign : num->width * sign;
 	return 0;
 }
 
+/*
+ * Digit-vector kernels behind addition, subtraction, comparison, the
+ * zero scan in krk_long_trim, and the bitwise operators. The portable
+ * versions are plain loops. On x86-64, AVX2 and AVX-512 versions are
+ * chosen at startup from what the processor reports (build with
+ * KRK_LONG_NO_SIMD to leave them out).
+ *
+ * Vector addition sums a block of digits at once; the spare bit of each
+ * lane then says whether it generates a carry, and a lane of all ones
+ * propagates one. Every lane's incoming carry falls out of one scalar
+ * addition of those two bit masks: c = (((g << 1) | carry_in) + p) ^ p,
+ * with the carry out of the block in the bit above the last lane.
+ * Subtraction is the same with borrows, where a zero lane propagates.
+ *
+ * add_n and sub_n read position i of their inputs before writing that
+ * position of the output, so the output may be either input. Vectors
+ * shorter than KRK_LONG_SIMD_MIN digits skip the dispatch.
+ */
+#ifndef KRK_LONG_SIMD_MIN
+#define KRK_LONG_SIMD_MIN 16
+#endif
+
+#if !defined(KRK_LONG_NO_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+#define KRK_LONG_SIMD
+#include <immintrin.h>
+#endif
+
+static digit_t _add_n_generic(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t carry) {
+	for (size_t i = 0; i < n; ++i) {
+		digit_t out = a[i] + b[i] + carry;
+		r[i] = out & DIGIT_MAX;
+		carry = out >> DIGIT_SHIFT;
+	}
+	return carry;
+}
+
+static digit_t _sub_n_generic(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t borrow) {
+	for (size_t i = 0; i < n; ++i) {
+		/* A borrow wraps around into the spare bit. */
+		digit_t out = a[i] - b[i] - borrow;
+		r[i] = out & DIGIT_MAX;
+		borrow = out >> DIGIT_SHIFT;
+	}
+	return borrow;
+}
+
+static int _cmp_n_generic(const digit_t * a, const digit_t * b, size_t n) {
+	while (n--) {
+		if (a[n] != b[n]) return a[n] > b[n] ? 1 : -1;
+	}
+	return 0;
+}
+
+/**
+ * How many of the n digits are left without the leading zeros.
+ */
+static size_t _width_generic(const digit_t * d, size_t n) {
+	while (n && d[n-1] == 0) n--;
+	return n;
+}
+
+/* Bitwise kernels: r = a op b over n digits, for and, or, xor and a & ~b. */
+#define BITWISE_GENERIC(name, expr) \
+	static void _ ## name ## _generic(digit_t * r, const digit_t * a, const digit_t * b, size_t n) { \
+		for (size_t i = 0; i < n; ++i) r[i] = expr; \
+	}
+
+BITWISE_GENERIC(and_n, a[i] & b[i])
+BITWISE_GENERIC(or_n, a[i] | b[i])
+BITWISE_GENERIC(xor_n, a[i] ^ b[i])
+BITWISE_GENERIC(andnot_n, a[i] & ~b[i])
+
+#ifdef KRK_LONG_SIMD
+#if KRK_LONG_DIGIT_BITS == 64
+# define V256_LANES       4
+# define v256_set1(x)     _mm256_set1_epi64x(x)
+# define v256_index()     _mm256_set_epi64x(3,2,1,0)
+# define v256_add         _mm256_add_epi64
+# define v256_sub         _mm256_sub_epi64
+# define v256_cmpeq       _mm256_cmpeq_epi64
+# define v256_srlv        _mm256_srlv_epi64
+# define v256_signs(x)    _mm256_movemask_pd(_mm256_castsi256_pd(x))
+# define V512_LANES       8
+# define v512_set1(x)     _mm512_set1_epi64(x)
+# define v512_add         _mm512_add_epi64
+# define v512_sub         _mm512_sub_epi64
+# define v512_mask_add    _mm512_mask_add_epi64
+# define v512_mask_sub    _mm512_mask_sub_epi64
+# define v512_cmpeq       _mm512_cmpeq_epi64_mask
+# define v512_cmpneq      _mm512_cmpneq_epi64_mask
+# define v512_test        _mm512_test_epi64_mask
+# define v512_signs(x)    _mm512_cmplt_epi64_mask(x, _mm512_setzero_si512())
+#else
+# define V256_LANES       8
+# define v256_set1(x)     _mm256_set1_epi32(x)
+# define v256_index()     _mm256_set_epi32(7,6,5,4,3,2,1,0)
+# define v256_add         _mm256_add_epi32
+# define v256_sub         _mm256_sub_epi32
+# define v256_cmpeq       _mm256_cmpeq_epi32
+# define v256_srlv        _mm256_srlv_epi32
+# define v256_signs(x)    _mm256_movemask_ps(_mm256_castsi256_ps(x))
+# define V512_LANES       16
+# define v512_set1(x)     _mm512_set1_epi32(x)
+# define v512_add         _mm512_add_epi32
+# define v512_sub         _mm512_sub_epi32
+# define v512_mask_add    _mm512_mask_add_epi32
+# define v512_mask_sub    _mm512_mask_sub_epi32
+# define v512_cmpeq       _mm512_cmpeq_epi32_mask
+# define v512_cmpneq      _mm512_cmpneq_epi32_mask
+# define v512_test        _mm512_test_epi32_mask
+# define v512_signs(x)    _mm512_cmplt_epi32_mask(x, _mm512_setzero_si512())
+#endif
+
+#define V256_ALL ((1u << V256_LANES) - 1)
+
+__attribute__((target("avx2")))
+static digit_t _add_n_avx2(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t carry) {
+	const __m256i max = v256_set1(DIGIT_MAX), one = v256_set1(1), index = v256_index();
+	size_t i = 0;
+	for (; i + V256_LANES <= n; i += V256_LANES) {
+		__m256i s = v256_add(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+		__m256i m = _mm256_and_si256(s, max);
+		unsigned g = v256_signs(s), p = v256_signs(v256_cmpeq(m, max));
+		unsigned c = (((g << 1) | carry) + p) ^ p;
+		carry = c >> V256_LANES;
+		__m256i cv = _mm256_and_si256(v256_srlv(v256_set1(c), index), one);
+		_mm256_storeu_si256((__m256i *)(r + i), _mm256_and_si256(v256_add(m, cv), max));
+	}
+	return _add_n_generic(r + i, a + i, b + i, n - i, carry);
+}
+
+__attribute__((target("avx2")))
+static digit_t _sub_n_avx2(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t borrow) {
+	const __m256i max = v256_set1(DIGIT_MAX), one = v256_set1(1), index = v256_index();
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + V256_LANES <= n; i += V256_LANES) {
+		__m256i d = v256_sub(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+		__m256i m = _mm256_and_si256(d, max);
+		unsigned g = v256_signs(d), p = v256_signs(v256_cmpeq(m, zero));
+		unsigned c = (((g << 1) | borrow) + p) ^ p;
+		borrow = c >> V256_LANES;
+		__m256i cv = _mm256_and_si256(v256_srlv(v256_set1(c), index), one);
+		_mm256_storeu_si256((__m256i *)(r + i), _mm256_and_si256(v256_sub(m, cv), max));
+	}
+	return _sub_n_generic(r + i, a + i, b + i, n - i, borrow);
+}
+
+__attribute__((target("avx2")))
+static int _cmp_n_avx2(const digit_t * a, const digit_t * b, size_t n) {
+	while (n >= V256_LANES) {
+		n -= V256_LANES;
+		unsigned eq = v256_signs(v256_cmpeq(_mm256_loadu_si256((const __m256i *)(a + n)), _mm256_loadu_si256((const __m256i *)(b + n))));
+		if (eq != V256_ALL) {
+			int lane = 31 - __builtin_clz(~eq & V256_ALL);
+			return a[n+lane] > b[n+lane] ? 1 : -1;
+		}
+	}
+	return _cmp_n_generic(a, b, n);
+}
+
+__attribute__((target("avx2")))
+static size_t _width_avx2(const digit_t * d, size_t n) {
+	while (n >= V256_LANES) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(d + n - V256_LANES));
+		if (!_mm256_testz_si256(x, x)) break;
+		n -= V256_LANES;
+	}
+	return _width_generic(d, n);
+}
+
+__attribute__((target("avx512f")))
+static digit_t _add_n_avx512(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t carry) {
+	const __m512i max = v512_set1(DIGIT_MAX), one = v512_set1(1);
+	size_t i = 0;
+	for (; i + V512_LANES <= n; i += V512_LANES) {
+		__m512i s = v512_add(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+		__m512i m = _mm512_and_si512(s, max);
+		unsigned g = v512_signs(s), p = v512_cmpeq(m, max);
+		unsigned c = (((g << 1) | carry) + p) ^ p;
+		carry = c >> V512_LANES;
+		m = v512_mask_add(m, c, m, one);
+		_mm512_storeu_si512(r + i, _mm512_and_si512(m, max));
+	}
+	return _add_n_generic(r + i, a + i, b + i, n - i, carry);
+}
+
+__attribute__((target("avx512f")))
+static digit_t _sub_n_avx512(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t borrow) {
+	const __m512i max = v512_set1(DIGIT_MAX), one = v512_set1(1);
+	size_t i = 0;
+	for (; i + V512_LANES <= n; i += V512_LANES) {
+		__m512i d = v512_sub(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+		__m512i m = _mm512_and_si512(d, max);
+		unsigned g = v512_signs(d), p = v512_cmpeq(m, _mm512_setzero_si512());
+		unsigned c = (((g << 1) | borrow) + p) ^ p;
+		borrow = c >> V512_LANES;
+		m = v512_mask_sub(m, c, m, one);
+		_mm512_storeu_si512(r + i, _mm512_and_si512(m, max));
+	}
+	return _sub_n_generic(r + i, a + i, b + i, n - i, borrow);
+}
+
+__attribute__((target("avx512f")))
+static int _cmp_n_avx512(const digit_t * a, const digit_t * b, size_t n) {
+	while (n >= V512_LANES) {
+		n -= V512_LANES;
+		unsigned ne = v512_cmpneq(_mm512_loadu_si512(a + n), _mm512_loadu_si512(b + n));
+		if (ne) {
+			int lane = 31 - __builtin_clz(ne);
+			return a[n+lane] > b[n+lane] ? 1 : -1;
+		}
+	}
+	return _cmp_n_generic(a, b, n);
+}
+
+__attribute__((target("avx512f")))
+static size_t _width_avx512(const digit_t * d, size_t n) {
+	while (n >= V512_LANES) {
+		__m512i x = _mm512_loadu_si512(d + n - V512_LANES);
+		if (v512_test(x, x)) break;
+		n -= V512_LANES;
+	}
+	return _width_generic(d, n);
+}
+
+#define BITWISE_SIMD(name, suffix, isa, bits, lanes, expr) \
+	__attribute__((target(isa))) \
+	static void _ ## name ## _ ## suffix(digit_t * r, const digit_t * a, const digit_t * b, size_t n) { \
+		size_t i = 0; \
+		for (; i + lanes <= n; i += lanes) { \
+			__m ## bits ## i x = _mm ## bits ## _loadu_si ## bits((const void *)(a + i)); \
+			__m ## bits ## i y = _mm ## bits ## _loadu_si ## bits((const void *)(b + i)); \
+			_mm ## bits ## _storeu_si ## bits((void *)(r + i), expr); \
+		} \
+		_ ## name ## _generic(r + i, a + i, b + i, n - i); \
+	}
+
+BITWISE_SIMD(and_n, avx2, "avx2", 256, V256_LANES, _mm256_and_si256(x, y))
+BITWISE_SIMD(or_n, avx2, "avx2", 256, V256_LANES, _mm256_or_si256(x, y))
+BITWISE_SIMD(xor_n, avx2, "avx2", 256, V256_LANES, _mm256_xor_si256(x, y))
+BITWISE_SIMD(andnot_n, avx2, "avx2", 256, V256_LANES, _mm256_andnot_si256(y, x))
+BITWISE_SIMD(and_n, avx512, "avx512f", 512, V512_LANES, _mm512_and_si512(x, y))
+BITWISE_SIMD(or_n, avx512, "avx512f", 512, V512_LANES, _mm512_or_si512(x, y))
+BITWISE_SIMD(xor_n, avx512, "avx512f", 512, V512_LANES, _mm512_xor_si512(x, y))
+BITWISE_SIMD(andnot_n, avx512, "avx512f", 512, V512_LANES, _mm512_andnot_si512(y, x))
+
+#undef BITWISE_SIMD
+#endif
+
+struct DigitKernels {
+	digit_t (*add_n)(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t carry);
+	digit_t (*sub_n)(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t borrow);
+	int (*cmp_n)(const digit_t * a, const digit_t * b, size_t n);
+	size_t (*width)(const digit_t * d, size_t n);
+	void (*bitwise[4])(digit_t * r, const digit_t * a, const digit_t * b, size_t n);
+};
+
+/* Index of each operation in DigitKernels.bitwise */
+enum { BITWISE_AND, BITWISE_OR, BITWISE_XOR, BITWISE_ANDNOT };
+
+#define DIGIT_KERNELS(suffix) { \
+	_add_n_ ## suffix, _sub_n_ ## suffix, _cmp_n_ ## suffix, _width_ ## suffix, \
+	{ _and_n_ ## suffix, _or_n_ ## suffix, _xor_n_ ## suffix, _andnot_n_ ## suffix } }
+
+static struct DigitKernels _kernels = DIGIT_KERNELS(generic);
+
+/**
+ * Use the widest kernels the processor supports, up to 'level': 0 for
+ * the portable loops, 1 for AVX2, 2 for AVX-512. Returns the level in use.
+ */
+static int krk_long_select_kernels(int level) {
+	static const struct DigitKernels generic = DIGIT_KERNELS(generic);
+	_kernels = generic;
+	int chosen = 0;
+#ifdef KRK_LONG_SIMD
+	static const struct DigitKernels avx2 = DIGIT_KERNELS(avx2);
+	static const struct DigitKernels avx512 = DIGIT_KERNELS(avx512);
+	__builtin_cpu_init();
+	if (level >= 1 && __builtin_cpu_supports("avx2")) {
+		_kernels = avx2;
+		chosen = 1;
+	}
+	if (level >= 2 && __builtin_cpu_supports("avx512f")) {
+		_kernels = avx512;
+		chosen = 2;
+	}
+#endif
+	return chosen;
+}
+
+#ifdef KRK_LONG_SIMD
+__attribute__((constructor))
+static void _select_kernels_at_startup(void) {
+	krk_long_select_kernels(2);
+}
+#endif
+
+static inline digit_t _add_n(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t carry) {
+	return n < KRK_LONG_SIMD_MIN ? _add_n_generic(r, a, b, n, carry) : _kernels.add_n(r, a, b, n, carry);
+}
+
+static inline digit_t _sub_n(digit_t * r, const digit_t * a, const digit_t * b, size_t n, digit_t borrow) {
+	return n < KRK_LONG_SIMD_MIN ? _sub_n_generic(r, a, b, n, borrow) : _kernels.sub_n(r, a, b, n, borrow);
+}
+
+/* Most comparisons and trims are settled by the top digit. */
+static inline int _cmp_n(const digit_t * a, const digit_t * b, size_t n) {
+	if (n && a[n-1] != b[n-1]) return a[n-1] > b[n-1] ? 1 : -1;
+	return n < KRK_LONG_SIMD_MIN ? _cmp_n_generic(a, b, n) : _kernels.cmp_n(a, b, n);
+}
+
+static inline size_t _digits_width(const digit_t * d, size_t n) {
+	if (!n || d[n-1]) return n;
+	return n < KRK_LONG_SIMD_MIN ? _width_generic(d, n) : _kernels.width(d, n);
+}
+
+static inline void _bitwise_n(int op, digit_t * r, const digit_t * a, const digit_t * b, size_t n) {
+	static void (* const generic[4])(digit_t *, const digit_t *, const digit_t *, size_t) = {
+		_and_n_generic, _or_n_generic, _xor_n_generic, _andnot_n_generic
+	};
+	(n < KRK_LONG_SIMD_MIN ? generic[op] : _kernels.bitwise[op])(r, a, b, n);
+}
+
+/**
+ * r = a + carry over n digits, returning the carry out. Once the carry
+ * stops the rest is a copy, which an in-place update skips.
+ */
+static digit_t _add_1(digit_t * r, const digit_t * a, size_t n, digit_t carry) {
+	size_t i = 0;
+	for (; carry && i < n; ++i) {
+		digit_t out = a[i] + carry;
+		r[i] = out & DIGIT_MAX;
+		carry = out >> DIGIT_SHIFT;
+	}
+	if (r != a && i < n) memcpy(r + i, a + i, sizeof(digit_t) * (n - i));
+	return carry;
+}
+
+/**
+ * r = a - borrow over n digits, returning the borrow out.
+ */
+static digit_t _sub_1(digit_t * r, const digit_t * a, size_t n, digit_t borrow) {
+	size_t i = 0;
+	for (; borrow && i < n; ++i) {
+		digit_t out = a[i] - borrow;
+		r[i] = out & DIGIT_MAX;
+		borrow = out >> DIGIT_SHIFT;
+	}
+	if (r != a && i < n) memcpy(r + i, a + i, sizeof(digit_t) * (n - i));
+	return borrow;
+}
+
 static int krk_long_trim(KrkLong * num) {
 	int invert = num->width < 0;
 	size_t owidth = invert ? -num->width : num->width;
-	size_t redundant = 0;
-	for (size_t i = 0; i < owidth; i++) {
-		if (num->digits[owidth-i-1] == 0) {
-			redundant++;
-		} else {
-			break;
-		}
-	}
+	size_t width = _digits_width(num->digits, owidth);
 
-	if (redundant) {
-		krk_long_resize(num, owidth - redundant);
+	if (width != owidth) {
+		krk_long_resize(num, width);
 		if (invert) krk_long_set_sign(num, -1);
 	}
+	return 0;
 }
 
 static int krk_long_compare(const KrkLong * a, const KrkLong * b) {
@@ -142,11 +939,7 @@ static int krk_long_compare(const KrkLong * a, const KrkLong * b) {
 	if (b->width > a->width) return -1;
 	int sign = a->width < 0 ? -1 : 1;
 	size_t abs_width = a->width < 0 ? -a->width : a->width;
-	for (size_t i = 0; i < abs_width; ++i) {
-		if (a->digits[abs_width-i-1] > b->digits[abs_width-i-1]) return sign; /* left is bigger */
-		if (a->digits[abs_width-i-1] < b->digits[abs_width-i-1]) return -sign; /* right is bigger */
-	}
-	return 0; /* they are the same */
+	return sign * _cmp_n(a->digits, b->digits, abs_width);
 }
 
 static int krk_long_compare_abs(const KrkLong * a, const KrkLong * b) {
@@ -154,29 +947,29 @@ static int krk_long_compare_abs(const KrkLong * a, const KrkLong * b) {
 	size_t b_width = b->width < 0 ? -b->width : b->width;
 	if (a_width > b_width) return 1;
 	if (b_width > a_width) return -1;
-	size_t abs_width = a_width;
-	for (size_t i = 0; i < abs_width; ++i) {
-		if (a->digits[abs_width-i-1] > b->digits[abs_width-i-1]) return 1; /* left is bigger */
-		if (a->digits[abs_width-i-1] < b->digits[abs_width-i-1]) return -1; /* right is bigger */
-	}
-	return 0; /* they are the same */
+	return _cmp_n(a->digits, b->digits, a_width);
 }
 
 static int krk_long_add_ignore_sign(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	size_t awidth = a->width < 0 ? -a->width : a->width;
 	size_t bwidth = b->width < 0 ? -b->width : b->width;
-	size_t owidth = awidth < bwidth ? bwidth + 1 : awidth + 1;
-	size_t carry  = 0;
-	krk_long_resize(res, owidth);
-	for (size_t i = 0; i < owidth - 1; ++i) {
-		uint32_t out = (i < awidth ? a->digits[i] : 0) + (i < bwidth ? b->digits[i] : 0) + carry;
-		res->digits[i] = out & DIGIT_MAX;
-		carry = out > DIGIT_MAX;
+	if (awidth < bwidth) {
+		const KrkLong * t = a;
+		a = b;
+		b = t;
+		size_t w = awidth;
+		awidth = bwidth;
+		bwidth = w;
 	}
+
+	/* Sum the overlap, then carry through the rest of the wider operand. */
+	krk_long_resize(res, awidth + 1);
+	digit_t carry = _add_n(res->digits, a->digits, b->digits, bwidth, 0);
+	carry = _add_1(res->digits + bwidth, a->digits + bwidth, awidth - bwidth, carry);
 	if (carry) {
-		res->digits[owidth-1] = 1;
+		res->digits[awidth] = 1;
 	} else {
-		krk_long_resize(res, owidth - 1);
+		krk_long_resize(res, awidth);
 	}
 	return 0;
 }
@@ -185,25 +978,10 @@ static int _sub_big_small(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	/* Subtract b from a, where a is bigger */
 	size_t awidth = a->width < 0 ? -a->width : a->width;
 	size_t bwidth = b->width < 0 ? -b->width : b->width;
-	size_t owidth = awidth;
-
-	krk_long_resize(res, owidth);
 
-	int carry = 0;
-
-	for (size_t i = 0; i < owidth; ++i) {
-		/* We'll do long subtraction? */
-		uint64_t a_digit = (i < awidth ? a->digits[i] : 0) - carry;
-		uint64_t b_digit = i < bwidth ? b->digits[i] : 0;
-
-		if (a_digit < b_digit) {
-			a_digit += 1 << DIGIT_SHIFT;
-			carry = 1;
-		} else {
-			carry = 0;
-		}
-		res->digits[i] = a_digit - b_digit;
-	}
+	krk_long_resize(res, awidth);
+	digit_t borrow = _sub_n(res->digits, a->digits, b->digits, bwidth, 0);
+	_sub_1(res->digits + bwidth, a->digits + bwidth, awidth - bwidth, borrow);
 
 	krk_long_trim(res);
 
@@ -211,12 +989,25 @@ static int _sub_big_small(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 }
 
 static int _swap(KrkLong * a, KrkLong * b) {
-	ssize_t width = a->width;
-	uint32_t * digits = a->digits;
-	a->width = b->width;
-	a->digits = b->digits;
-	b->width = width;
-	b->digits = digits;
+	KrkLong tmp = *a;
+	*a = *b;
+	*b = tmp;
+	/* Inline digits moved with the structs; point back at them. */
+	if (a->digits == b->inline_digits) a->digits = a->inline_digits;
+	if (b->digits == a->inline_digits) b->digits = b->inline_digits;
+	return 0;
+}
+
+/**
+ * Transfer the value of 'in' to 'out', which is treated as uninitialized.
+ * 'in' is left as zero.
+ */
+static int krk_long_move(KrkLong * out, KrkLong * in) {
+	*out = *in;
+	if (in->digits == in->inline_digits) out->digits = out->inline_digits;
+	in->width = 0;
+	in->digits = NULL;
+	in->capacity = 0;
 	return 0;
 }
 
@@ -224,102 +1015,73 @@ static int _swap(KrkLong * a, KrkLong * b) {
 #define PREP_OUTPUT1(res,a) KrkLong _tmp_out_ ## res, *_swap_out_ ## res = NULL; do { if (res == a) { krk_long_init_si(&_tmp_out_ ## res, 0); _swap_out_ ## res = res;  res = &_tmp_out_ ## res; } } while (0)
 #define FINISH_OUTPUT(res) do { if (_swap_out_ ## res) { _swap(_swap_out_ ## res, res); krk_long_clear(&_tmp_out_ ## res); } } while (0)
 
+/*
+ * The addition and subtraction kernels read each digit of their inputs
+ * before writing that position of the output, so 'res' may be either
+ * operand; in-place updates reuse its buffer when it is large enough.
+ */
 static int krk_long_add(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
+	STAT_CALL(STAT_ADD, _stat_width(a, b));
+	if (a->width == 0) return krk_long_set(res,b);
+	if (b->width == 0) return krk_long_set(res,a);
 
-	if (a->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,b);
-		FINISH_OUTPUT(res);
-		return 0;
-	} else if (b->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,a);
-		FINISH_OUTPUT(res);
+	int asign = a->width < 0 ? -1 : 1;
+	int bsign = b->width < 0 ? -1 : 1;
+
+	if (asign == bsign) {
+		if (krk_long_add_ignore_sign(res,a,b)) return 1;
+		krk_long_set_sign(res,asign);
 		return 0;
 	}
 
-	if (a->width < 0 && b->width > 0) {
-		switch (krk_long_compare_abs(a,b)) {
-			case -1:
-				_sub_big_small(res,b,a);
-				krk_long_set_sign(res,1);
-				FINISH_OUTPUT(res);
-				return 0;
-			case 1:
-				_sub_big_small(res,a,b);
-				krk_long_set_sign(res,-1);
-				FINISH_OUTPUT(res);
-				return 0;
-		}
-		return 1;
-	} else if (a->width > 0 && b->width < 0) {
-		switch (krk_long_compare_abs(a,b)) {
-			case -1:
-				_sub_big_small(res,b,a);
-				krk_long_set_sign(res,-1);
-				FINISH_OUTPUT(res);
-				return 0;
-			case 1:
-				_sub_big_small(res,a,b);
-				krk_long_set_sign(res,1);
-				FINISH_OUTPUT(res);
-				return 0;
-		}
-		FINISH_OUTPUT(res);
-		return 1;
+	switch (krk_long_compare_abs(a,b)) {
+		case -1:
+			_sub_big_small(res,b,a);
+			krk_long_set_sign(res,bsign);
+			return 0;
+		case 1:
+			_sub_big_small(res,a,b);
+			krk_long_set_sign(res,asign);
+			return 0;
 	}
 
-	/* sign must match for this, so take it from whichever */
-	int sign = a->width < 0 ? -1 : 1;
-	if (krk_long_add_ignore_sign(res,a,b)) {
-		FINISH_OUTPUT(res);
-		return 1;
-	}
-	krk_long_set_sign(res,sign);
-	FINISH_OUTPUT(res);
+	krk_long_resize(res,0);
 	return 0;
 }
 
 static int krk_long_sub(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
+	STAT_CALL(STAT_SUB, _stat_width(a, b));
+	if (b->width == 0) return krk_long_set(res,a);
+
+	int asign = a->width < 0 ? -1 : 1;
+	int bsign = b->width < 0 ? -1 : 1;
+
 	if (a->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,b);
-		krk_long_set_sign(res, b->width < 0 ? 1 : -1);
-		FINISH_OUTPUT(res);
-		return 0;
-	} else if (b->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,a);
-		FINISH_OUTPUT(res);
+		krk_long_set(res,b);
+		krk_long_set_sign(res,-bsign);
 		return 0;
 	}
 
-	if (a->width < 0 && b->width > 0 || a->width > 0 && b->width < 0) {
-		if (krk_long_add_ignore_sign(res,a,b)) { FINISH_OUTPUT(res); return 1; }
-		krk_long_set_sign(res,a->width < 0 ? -1 : 1);
-		FINISH_OUTPUT(res);
+	if (asign != bsign) {
+		if (krk_long_add_ignore_sign(res,a,b)) return 1;
+		krk_long_set_sign(res,asign);
 		return 0;
 	}
 
 	/* Which is bigger? */
 	switch (krk_long_compare_abs(a,b)) {
-		case 0:
-			krk_long_clear(res);
-			FINISH_OUTPUT(res);
-			return 0;
 		case 1:
 			_sub_big_small(res,a,b);
-			if (a->width < 0) krk_long_set_sign(res, -1);
-			FINISH_OUTPUT(res);
+			krk_long_set_sign(res,asign);
 			return 0;
 		case -1:
 			_sub_big_small(res,b,a);
-			if (b->width > 0) krk_long_set_sign(res, -1);
-			FINISH_OUTPUT(res);
+			krk_long_set_sign(res,-bsign);
 			return 0;
 	}
+
+	krk_long_resize(res,0);
+	return 0;
 }
 
 static int krk_long_zero(KrkLong * num) {
@@ -330,8 +1092,497 @@ static int krk_long_zero(KrkLong * num) {
 	return 0;
 }
 
-static int _mul_abs(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-
+/*
+ * Multiplication switches algorithms based on the width (in digits) of the
+ * smaller operand. These can be overridden at build time for tuning; the
+ * defaults depend on the digit size.
+ */
+#if KRK_LONG_DIGIT_BITS == 64
+# define _CUTOFF(wide,narrow) (wide)
+#else
+# define _CUTOFF(wide,narrow) (narrow)
+#endif
+#ifndef KRK_LONG_KARATSUBA_CUTOFF
+#define KRK_LONG_KARATSUBA_CUTOFF _CUTOFF(32,64)
+#endif
+#ifndef KRK_LONG_TOOM3_CUTOFF
+#define KRK_LONG_TOOM3_CUTOFF _CUTOFF(150,250)
+#endif
+#ifndef KRK_LONG_TOOM4_CUTOFF
+#define KRK_LONG_TOOM4_CUTOFF _CUTOFF(500,1000)
+#endif
+
+/*
+ * Squaring computes each cross product once, so its schoolbook range runs
+ * further and it has its own set of cutoffs.
+ */
+#ifndef KRK_LONG_SQR_KARATSUBA_CUTOFF
+#define KRK_LONG_SQR_KARATSUBA_CUTOFF _CUTOFF(48,96)
+#endif
+#ifndef KRK_LONG_SQR_TOOM3_CUTOFF
+#define KRK_LONG_SQR_TOOM3_CUTOFF _CUTOFF(200,400)
+#endif
+#ifndef KRK_LONG_SQR_TOOM4_CUTOFF
+#define KRK_LONG_SQR_TOOM4_CUTOFF _CUTOFF(600,1200)
+#endif
+
+static int krk_long_mul(KrkLong * res, const KrkLong * a, const KrkLong * b);
+static int krk_long_sqr(KrkLong * res, const KrkLong * a);
+
+/*
+ * Worker threads for very large products. Once krk_long_set_threads has
+ * started them, the independent sub-products of Karatsuba and Toom-Cook
+ * and the transforms of NTT multiplication are forked as tasks and
+ * joined before their results are combined.
+ *
+ * Each worker owns a deque of tasks, pushing and popping its own at the
+ * bottom while idle threads steal from the top of the others; threads
+ * outside the pool share one more deque. A thread waiting on a join
+ * runs whatever tasks it can find until its own are done, so forks nest.
+ *
+ * Workers allocate with malloc rather than the installed allocator,
+ * which may only be usable from the thread (or VM) that installed it.
+ * A sub-product computed for another thread is copied into storage that
+ * thread reserved for it beforehand.
+ *
+ * Reconfiguring the pool waits for running operations. The outermost
+ * multiplication, squaring or conversion on a thread takes a read lock
+ * on the configuration if the pool is running, and every choice it makes
+ * about forking uses the thread count it saw on entry; with the pool
+ * stopped it takes no lock and never forks.
+ */
+#if !defined(KRK_LONG_NO_THREADS) && !defined(KRK_DISABLE_THREADS) && defined(__unix__)
+#define KRK_LONG_THREADS
+#include <pthread.h>
+#endif
+
+#ifndef KRK_LONG_PARALLEL_CUTOFF
+#define KRK_LONG_PARALLEL_CUTOFF _CUTOFF(2000,4000)
+#endif
+#define KRK_LONG_MAX_THREADS 64
+#define KRK_LONG_DEQUE_SIZE  256
+#define KRK_LONG_FORK_MAX    8
+
+static int _threads = 1;
+static size_t _parallel_cutoff = KRK_LONG_PARALLEL_CUTOFF;
+
+/* Threads the operation running on this thread may use, fixed on entry */
+static KRK_LONG_THREAD_LOCAL int _fork_threads = 1;
+
+#ifdef KRK_LONG_THREADS
+struct TaskGroup {
+	size_t pending;
+};
+
+struct Task {
+	void (*job)(void *);
+	void * arg;
+	struct TaskGroup * group;
+};
+
+struct TaskDeque {
+	pthread_mutex_t lock;
+	size_t top, bottom;
+	struct Task * tasks[KRK_LONG_DEQUE_SIZE];
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;   /* signalled when a task is queued */
+	pthread_cond_t done;   /* broadcast when a task group finishes */
+	pthread_rwlock_t config; /* read by running operations, written to reconfigure */
+	ssize_t queued;
+	int stopping;
+	int workers;
+	pthread_t ids[KRK_LONG_MAX_THREADS - 1];
+	struct TaskDeque deques[KRK_LONG_MAX_THREADS]; /* the last is shared by threads outside the pool */
+} _workers = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.config = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+static KRK_LONG_THREAD_LOCAL struct TaskDeque * _own_deque;
+static KRK_LONG_THREAD_LOCAL int _pool_depth;
+static KRK_LONG_THREAD_LOCAL int _pool_locked;
+
+static struct TaskDeque * _task_deque(void) {
+	return _own_deque ? _own_deque : &_workers.deques[KRK_LONG_MAX_THREADS - 1];
+}
+
+/**
+ * Queue a task on the calling thread's deque. Returns 1 if it is full.
+ */
+static int _task_push(struct Task * task) {
+	struct TaskDeque * deque = _task_deque();
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom - deque->top == KRK_LONG_DEQUE_SIZE) {
+		pthread_mutex_unlock(&deque->lock);
+		return 1;
+	}
+	deque->tasks[deque->bottom++ % KRK_LONG_DEQUE_SIZE] = task;
+	pthread_mutex_unlock(&deque->lock);
+
+	pthread_mutex_lock(&_workers.lock);
+	__atomic_add_fetch(&_workers.queued, 1, __ATOMIC_ACQ_REL);
+	pthread_cond_signal(&_workers.work);
+	pthread_mutex_unlock(&_workers.lock);
+	return 0;
+}
+
+/**
+ * The newest task on the calling thread's deque, or else the oldest on
+ * any other, or NULL if every deque is empty.
+ */
+static struct Task * _task_take(void) {
+	struct TaskDeque * own = _task_deque();
+	struct Task * task = NULL;
+
+	pthread_mutex_lock(&own->lock);
+	if (own->bottom != own->top) task = own->tasks[--own->bottom % KRK_LONG_DEQUE_SIZE];
+	pthread_mutex_unlock(&own->lock);
+
+	int workers = __atomic_load_n(&_workers.workers, __ATOMIC_ACQUIRE);
+	for (int i = 0; !task && i <= workers; ++i) {
+		struct TaskDeque * deque = &_workers.deques[i == workers ? KRK_LONG_MAX_THREADS - 1 : i];
+		if (deque == own) continue;
+		pthread_mutex_lock(&deque->lock);
+		if (deque->bottom != deque->top) task = deque->tasks[deque->top++ % KRK_LONG_DEQUE_SIZE];
+		pthread_mutex_unlock(&deque->lock);
+	}
+
+	if (task) __atomic_sub_fetch(&_workers.queued, 1, __ATOMIC_ACQ_REL);
+	return task;
+}
+
+static void _task_run(struct Task * task) {
+	task->job(task->arg);
+	if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&_workers.lock);
+		pthread_cond_broadcast(&_workers.done);
+		pthread_mutex_unlock(&_workers.lock);
+	}
+}
+
+/**
+ * Wait for every task in a group, running queued tasks meanwhile. Only
+ * once none are left to take does the caller sleep; by then each of its
+ * own tasks has been taken by a thread that is running it.
+ */
+static void _task_join(struct TaskGroup * group) {
+	while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) {
+		struct Task * task = _task_take();
+		if (task) {
+			_task_run(task);
+			continue;
+		}
+		pthread_mutex_lock(&_workers.lock);
+		if (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) pthread_cond_wait(&_workers.done, &_workers.lock);
+		pthread_mutex_unlock(&_workers.lock);
+	}
+}
+
+static void * _worker_main(void * deque) {
+	_own_deque = deque;
+	_worker_heap = 1;
+	/* Tasks are parts of an operation that already holds the configuration */
+	_pool_depth = 1;
+	_fork_threads = __atomic_load_n(&_threads, __ATOMIC_ACQUIRE);
+#ifdef KRK_LONG_STATS
+	/* Jobs are parts of an operation already being timed */
+	_stat_depth = 1;
+#endif
+
+	for (;;) {
+		struct Task * task = _task_take();
+		if (task) {
+			_task_run(task);
+			continue;
+		}
+		pthread_mutex_lock(&_workers.lock);
+		while (__atomic_load_n(&_workers.queued, __ATOMIC_ACQUIRE) <= 0 && !_workers.stopping) {
+			pthread_cond_wait(&_workers.work, &_workers.lock);
+		}
+		int stopping = _workers.stopping;
+		pthread_mutex_unlock(&_workers.lock);
+		if (stopping) break;
+	}
+
+	krk_long_pool_drain();
+	return NULL;
+}
+
+static void _workers_init(void) {
+	for (int i = 0; i < KRK_LONG_MAX_THREADS; ++i) pthread_mutex_init(&_workers.deques[i].lock, NULL);
+}
+
+static void _workers_stop(void) {
+	pthread_mutex_lock(&_workers.lock);
+	_workers.stopping = 1;
+	pthread_cond_broadcast(&_workers.work);
+	pthread_mutex_unlock(&_workers.lock);
+
+	for (int i = 0; i < _workers.workers; ++i) pthread_join(_workers.ids[i], NULL);
+	__atomic_store_n(&_workers.workers, 0, __ATOMIC_RELEASE);
+	_workers.stopping = 0;
+	__atomic_store_n(&_threads, 1, __ATOMIC_RELEASE);
+}
+
+static void _pool_enter(void) {
+	if (_pool_depth++) return;
+	if (__atomic_load_n(&_threads, __ATOMIC_ACQUIRE) == 1) return;
+	pthread_rwlock_rdlock(&_workers.config);
+	_pool_locked = 1;
+	_fork_threads = __atomic_load_n(&_threads, __ATOMIC_ACQUIRE);
+}
+
+static void _pool_leave(int * scope) {
+	if (--_pool_depth) return;
+	if (_pool_locked) {
+		_pool_locked = 0;
+		pthread_rwlock_unlock(&_workers.config);
+	}
+	_fork_threads = 1;
+}
+
+/* Hold the pool configuration until the enclosing block ends */
+#define POOL_SCOPE() int _pool_scope __attribute__((cleanup(_pool_leave))) = (_pool_enter(), 0)
+#else
+#define POOL_SCOPE() do { } while (0)
+#endif
+
+/**
+ * Let large multiplications use up to 'count' threads, counting the
+ * calling one; 1 (or less) stops the workers and runs everything on the
+ * caller. Waits for operations using the pool on other threads to
+ * finish, and must not be called from within one. Returns 1, leaving the
+ * pool stopped, if the threads could not be started or this build has no
+ * thread support.
+ */
+static int krk_long_set_threads(int count) {
+#ifdef KRK_LONG_THREADS
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, _workers_init);
+	pthread_rwlock_wrlock(&_workers.config);
+	_workers_stop();
+
+	if (count > KRK_LONG_MAX_THREADS) count = KRK_LONG_MAX_THREADS;
+	if (count > 1) __atomic_store_n(&_threads, count, __ATOMIC_RELEASE);
+	while (_workers.workers < count - 1) {
+		int i = _workers.workers;
+		if (pthread_create(&_workers.ids[i], NULL, _worker_main, &_workers.deques[i])) {
+			_workers_stop();
+			pthread_rwlock_unlock(&_workers.config);
+			return 1;
+		}
+		__atomic_store_n(&_workers.workers, i + 1, __ATOMIC_RELEASE);
+	}
+
+	pthread_rwlock_unlock(&_workers.config);
+	return 0;
+#else
+	return count > 1;
+#endif
+}
+
+static int krk_long_threads(void) {
+	return __atomic_load_n(&_threads, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Set the narrowest operand, in digits, for which a multiplication
+ * forks its sub-products. Like krk_long_set_threads, waits for running
+ * operations. Returns the previous value.
+ */
+static size_t krk_long_set_parallel_cutoff(size_t digits) {
+#ifdef KRK_LONG_THREADS
+	pthread_rwlock_wrlock(&_workers.config);
+#endif
+	size_t previous = __atomic_exchange_n(&_parallel_cutoff, digits, __ATOMIC_ACQ_REL);
+#ifdef KRK_LONG_THREADS
+	pthread_rwlock_unlock(&_workers.config);
+#endif
+	return previous;
+}
+
+/*
+ * Only changed while no operation holds the configuration, so within
+ * one it is stable; the atomic load covers operations with the pool
+ * stopped, which take no lock.
+ */
+static size_t _fork_cutoff(void) {
+	return __atomic_load_n(&_parallel_cutoff, __ATOMIC_RELAXED);
+}
+
+/**
+ * Call 'job' on each of 'count' arguments laid out 'size' bytes apart,
+ * spreading them over the pool when it is running, and return once all
+ * of them have finished.
+ */
+static void _fork_join(void (*job)(void *), void * args, size_t size, int count) {
+	char * arg = args;
+	assert(count <= KRK_LONG_FORK_MAX);
+#ifdef KRK_LONG_THREADS
+	if (_fork_threads > 1 && count > 1) {
+		STAT_TIER(TIER_FORK);
+		struct TaskGroup group = { count - 1 };
+		struct Task tasks[KRK_LONG_FORK_MAX];
+		for (int i = 1; i < count; ++i) {
+			tasks[i] = (struct Task){ job, arg + i * size, &group };
+			if (_task_push(&tasks[i])) _task_run(&tasks[i]);
+		}
+		job(arg);
+		_task_join(&group);
+		return;
+	}
+#endif
+	for (int i = 0; i < count; ++i) job(arg + i * size);
+}
+
+/* out = x * y, or x * x if y is NULL */
+struct MulJob {
+	KrkLong * out;
+	const KrkLong * x;
+	const KrkLong * y;
+};
+
+/**
+ * Hand a result computed by a forked job back to its owner: copy tmp
+ * into 'out', which the owner reserved to be wide enough, and free tmp
+ * on the thread that allocated it.
+ */
+static void _deliver(KrkLong * out, KrkLong * tmp) {
+	size_t width = tmp->width < 0 ? -tmp->width : tmp->width;
+	if (width) memcpy(out->digits, tmp->digits, sizeof(digit_t) * width);
+	out->width = tmp->width;
+	krk_long_clear(tmp);
+}
+
+static void _mul_job(void * arg) {
+	struct MulJob * job = arg;
+	KrkLong tmp;
+	krk_long_init_si(&tmp, 0);
+	if (job->y) krk_long_mul(&tmp, job->x, job->y);
+	else krk_long_sqr(&tmp, job->x);
+	_deliver(job->out, &tmp);
+}
+
+/**
+ * Compute a set of independent products, forking them once the pool is
+ * running and every operand is at least the parallel cutoff wide.
+ */
+static void _products(struct MulJob * jobs, int count) {
+	size_t narrowest = SIZE_MAX;
+	for (int i = 0; i < count; ++i) {
+		size_t x = jobs[i].x->width < 0 ? -jobs[i].x->width : jobs[i].x->width;
+		size_t y = !jobs[i].y ? x : (size_t)(jobs[i].y->width < 0 ? -jobs[i].y->width : jobs[i].y->width);
+		if (x < narrowest) narrowest = x;
+		if (y < narrowest) narrowest = y;
+	}
+
+	if (_fork_threads > 1 && narrowest >= _fork_cutoff()) {
+		for (int i = 0; i < count; ++i) {
+			size_t x = jobs[i].x->width < 0 ? -jobs[i].x->width : jobs[i].x->width;
+			size_t y = !jobs[i].y ? x : (size_t)(jobs[i].y->width < 0 ? -jobs[i].y->width : jobs[i].y->width);
+			krk_long_reserve(jobs[i].out, x + y);
+		}
+		_fork_join(_mul_job, jobs, sizeof(struct MulJob), count);
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (jobs[i].y) krk_long_mul(jobs[i].out, jobs[i].x, jobs[i].y);
+		else krk_long_sqr(jobs[i].out, jobs[i].x);
+	}
+}
+
+/**
+ * Borrow a read-only, non-negative window of digits from 'in'.
+ * The view shares storage with 'in' and must never be resized or cleared.
+ */
+static void _view(KrkLong * out, const KrkLong * in, size_t offset, size_t count) {
+	size_t abs_width = in->width < 0 ? -in->width : in->width;
+	out->capacity = 0;
+	if (offset >= abs_width) {
+		out->width = 0;
+		out->digits = NULL;
+		return;
+	}
+	if (count > abs_width - offset) count = abs_width - offset;
+	while (count && in->digits[offset+count-1] == 0) count--;
+	out->width = count;
+	out->digits = count ? in->digits + offset : NULL;
+}
+
+/**
+ * Add the magnitude of 'a' into 'res' starting at digit 'offset'.
+ * 'res' must already be wide enough to hold the sum.
+ */
+static void _add_at(KrkLong * res, const KrkLong * a, size_t offset) {
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	size_t rwidth = res->width;
+	digit_t carry = 0;
+	for (size_t i = 0; i < awidth; ++i) {
+		digit_t out = res->digits[offset+i] + a->digits[i] + carry;
+		res->digits[offset+i] = out & DIGIT_MAX;
+		carry = out >> DIGIT_SHIFT;
+	}
+	for (size_t i = offset + awidth; carry && i < rwidth; ++i) {
+		digit_t out = res->digits[i] + carry;
+		res->digits[i] = out & DIGIT_MAX;
+		carry = out >> DIGIT_SHIFT;
+	}
+}
+
+/**
+ * res = a * k, for a small k. 'res' may be 'a'.
+ */
+static int _mul_small(KrkLong * res, const KrkLong * a, digit_t k) {
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	int sign = a->width < 0 ? -1 : 1;
+
+	if (awidth == 0 || k == 0) {
+		krk_long_clear(res);
+		return 0;
+	}
+
+	if (res != a) krk_long_clear(res);
+	krk_long_resize(res, awidth + 1);
+
+	ddigit_t carry = 0;
+	for (size_t i = 0; i < awidth; ++i) {
+		ddigit_t tmp = (ddigit_t)a->digits[i] * k + carry;
+		res->digits[i] = tmp & DIGIT_MAX;
+		carry = tmp >> DIGIT_SHIFT;
+	}
+	res->digits[awidth] = carry;
+
+	krk_long_trim(res);
+	krk_long_set_sign(res, sign);
+	return 0;
+}
+
+/**
+ * Divide in place by a small divisor that is known to divide evenly,
+ * as happens during Toom-Cook interpolation. Sign is preserved.
+ */
+static int _div_exact_small(KrkLong * num, digit_t d) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+	ddigit_t remainder = 0;
+	for (size_t i = 0; i < abs_width; ++i) {
+		size_t _i = abs_width - i - 1;
+		remainder = (remainder << DIGIT_SHIFT) | num->digits[_i];
+		digit_t r;
+		num->digits[_i] = _div_wide(remainder, d, &r);
+		remainder = r;
+	}
+	assert(remainder == 0);
+	krk_long_trim(num);
+	return 0;
+}
+
+static int _mul_basecase(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	size_t awidth = a->width < 0 ? -a->width : a->width;
 	size_t bwidth = b->width < 0 ? -b->width : b->width;
 
@@ -339,11 +1590,11 @@ static int _mul_abs(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	krk_long_zero(res);
 
 	for (size_t i = 0; i < bwidth; ++i) {
-		uint64_t b_digit = b->digits[i];
-		uint64_t carry = 0;
+		ddigit_t b_digit = b->digits[i];
+		ddigit_t carry = 0;
 		for (size_t j = 0; j < awidth; ++j) {
-			uint64_t a_digit = a->digits[j];
-			uint64_t tmp = carry + a_digit * b_digit + res->digits[i+j];
+			ddigit_t a_digit = a->digits[j];
+			ddigit_t tmp = carry + a_digit * b_digit + res->digits[i+j];
 			carry = tmp >> DIGIT_SHIFT;
 			res->digits[i+j] = tmp & DIGIT_MAX;
 		}
@@ -355,105 +1606,870 @@ static int _mul_abs(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	return 0;
 }
 
-static int krk_long_mul(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
+/**
+ * Karatsuba: a = a1*B^m + a0, b = b1*B^m + b0
+ * a*b = z2*B^2m + ((a0+a1)(b0+b1) - z2 - z0)*B^m + z0
+ */
+static int _mul_karatsuba(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	size_t m = (a->width + 1) / 2;
+
+	KrkLong a0, a1, b0, b1;
+	_view(&a0, a, 0, m);
+	_view(&a1, a, m, a->width);
+	_view(&b0, b, 0, m);
+	_view(&b1, b, m, b->width);
+
+	KrkLong z0, z1, z2, sa, sb;
+	krk_long_init_many(&z0, &z1, &z2, &sa, &sb, NULL);
+
+	krk_long_add(&sa, &a0, &a1);
+	krk_long_add(&sb, &b0, &b1);
+	struct MulJob jobs[] = { { &z0, &a0, &b0 }, { &z2, &a1, &b1 }, { &z1, &sa, &sb } };
+	_products(jobs, 3);
+	krk_long_sub(&z1, &z1, &z0);
+	krk_long_sub(&z1, &z1, &z2);
+
+	krk_long_resize(res, a->width + b->width);
+	krk_long_zero(res);
+	_add_at(res, &z0, 0);
+	_add_at(res, &z1, m);
+	_add_at(res, &z2, 2 * m);
+	krk_long_trim(res);
 
-	if (a->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,a);
-		FINISH_OUTPUT(res);
-		return 0;
-	}
+	krk_long_clear_many(&z0, &z1, &z2, &sa, &sb, NULL);
+	return 0;
+}
 
-	if (b->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,b);
-		FINISH_OUTPUT(res);
-		return 0;
-	}
+/**
+ * Evaluate a three-piece split of 'x' at 1, -1 and -2.
+ */
+static void _toom3_eval(const KrkLong * x, KrkLong * p1, KrkLong * pm1, KrkLong * pm2) {
+	KrkLong p;
+	krk_long_init_si(&p, 0);
+
+	/* p(1) = a0+a1+a2, p(-1) = a0-a1+a2, p(-2) = (p(-1)+a2)*2-a0 */
+	krk_long_add(&p, &x[0], &x[2]);
+	krk_long_add(p1, &p, &x[1]);
+	krk_long_sub(pm1, &p, &x[1]);
+	krk_long_add(pm2, pm1, &x[2]);
+	_mul_small(pm2, pm2, 2);
+	krk_long_sub(pm2, pm2, &x[0]);
+
+	krk_long_clear(&p);
+}
 
-	if (_mul_abs(res,a,b)) {
-		FINISH_OUTPUT(res);
-		return 1;
+/**
+ * Recover the coefficients of a Toom-3 product from its values at 0, 1,
+ * -1, -2 and infinity with Bodrato's interpolation sequence, and sum them
+ * into 'res' at multiples of 'm' digits. Clobbers r1, rm1 and rm2.
+ */
+static void _toom3_interpolate(KrkLong * res, size_t width, size_t m, const KrkLong * r0, KrkLong * r1, KrkLong * rm1, KrkLong * rm2, const KrkLong * rinf) {
+	/* Each of these ends up as a (non-negative) coefficient. */
+	KrkLong * c1 = r1, * r2 = rm1, * r3 = rm2;
+	KrkLong t;
+	krk_long_init_si(&t, 0);
+
+	krk_long_sub(r3, rm2, r1);
+	_div_exact_small(r3, 3);
+	krk_long_sub(c1, r1, rm1);
+	_div_exact_small(c1, 2);
+	krk_long_sub(r2, rm1, r0);
+	krk_long_sub(r3, r2, r3);
+	_div_exact_small(r3, 2);
+	_mul_small(&t, rinf, 2);
+	krk_long_add(r3, r3, &t);
+	krk_long_add(r2, r2, c1);
+	krk_long_sub(r2, r2, rinf);
+	krk_long_sub(c1, c1, r3);
+
+	krk_long_resize(res, width);
+	krk_long_zero(res);
+	_add_at(res, r0, 0);
+	_add_at(res, c1, m);
+	_add_at(res, r2, 2 * m);
+	_add_at(res, r3, 3 * m);
+	_add_at(res, rinf, 4 * m);
+	krk_long_trim(res);
+
+	krk_long_clear(&t);
+}
+
+/**
+ * Toom-3, evaluating at 0, 1, -1, -2, and infinity.
+ */
+static int _mul_toom3(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	size_t m = (a->width + 2) / 3;
+
+	KrkLong x[3], y[3];
+	for (int i = 0; i < 3; ++i) {
+		_view(&x[i], a, i * m, i == 2 ? (size_t)a->width : m);
+		_view(&y[i], b, i * m, i == 2 ? (size_t)b->width : m);
 	}
 
-	if (a->width < 0 == b->width < 0) {
-		krk_long_set_sign(res,1);
-	} else {
-		krk_long_set_sign(res,-1);
+	KrkLong p1, pm1, pm2, q1, qm1, qm2, r0, r1, rm1, rm2, rinf;
+	krk_long_init_many(&p1, &pm1, &pm2, &q1, &qm1, &qm2, &r0, &r1, &rm1, &rm2, &rinf, NULL);
+
+	_toom3_eval(x, &p1, &pm1, &pm2);
+	_toom3_eval(y, &q1, &qm1, &qm2);
+
+	struct MulJob jobs[] = {
+		{ &r0, &x[0], &y[0] }, { &r1, &p1, &q1 }, { &rm1, &pm1, &qm1 }, { &rm2, &pm2, &qm2 }, { &rinf, &x[2], &y[2] },
+	};
+	_products(jobs, 5);
+
+	_toom3_interpolate(res, a->width + b->width, m, &r0, &r1, &rm1, &rm2, &rinf);
+
+	krk_long_clear_many(&p1, &pm1, &pm2, &q1, &qm1, &qm2, &r0, &r1, &rm1, &rm2, &rinf, NULL);
+	return 0;
+}
+
+/**
+ * Evaluate a four-piece split of 'x' at 1, -1, 2, -2 and 8*(1/2).
+ */
+static void _toom4_eval(const KrkLong * x, KrkLong * p1, KrkLong * pm1, KrkLong * p2, KrkLong * pm2, KrkLong * ph) {
+	KrkLong e, o;
+	krk_long_init_many(&e, &o, NULL);
+
+	krk_long_add(&e, &x[0], &x[2]);
+	krk_long_add(&o, &x[1], &x[3]);
+	krk_long_add(p1, &e, &o);
+	krk_long_sub(pm1, &e, &o);
+
+	_mul_small(&e, &x[2], 4);
+	krk_long_add(&e, &e, &x[0]);
+	_mul_small(&o, &x[3], 4);
+	krk_long_add(&o, &o, &x[1]);
+	_mul_small(&o, &o, 2);
+	krk_long_add(p2, &e, &o);
+	krk_long_sub(pm2, &e, &o);
+
+	_mul_small(ph, &x[0], 2);
+	krk_long_add(ph, ph, &x[1]);
+	_mul_small(ph, ph, 2);
+	krk_long_add(ph, ph, &x[2]);
+	_mul_small(ph, ph, 2);
+	krk_long_add(ph, ph, &x[3]);
+
+	krk_long_clear_many(&e, &o, NULL);
+}
+
+/**
+ * Recover the coefficients of a Toom-4 product from its values at 0, 1,
+ * -1, 2, -2, 8*(1/2) and infinity, and sum them into 'res' at multiples
+ * of 'm' digits. Interpolation separates the even and odd coefficients
+ * using the symmetric point pairs, then solves the rest with the point
+ * at 1/2; every division along the way is exact. Clobbers rh.
+ */
+static void _toom4_interpolate(KrkLong * res, size_t width, size_t m, const KrkLong * c0, const KrkLong * r1, const KrkLong * rm1,
+                               const KrkLong * r2, const KrkLong * rm2, KrkLong * rh, const KrkLong * c6) {
+	KrkLong e1, o1, e2, o2, c1, c2, c3, c4, c5, t;
+	krk_long_init_many(&e1, &o1, &e2, &o2, &c1, &c2, &c3, &c4, &c5, &t, NULL);
+
+	/* e1 = c2+c4+c6+c0, o1 = c1+c3+c5 */
+	krk_long_add(&e1, r1, rm1);
+	_div_exact_small(&e1, 2);
+	krk_long_sub(&o1, r1, rm1);
+	_div_exact_small(&o1, 2);
+
+	/* e2 = c0+4c2+16c4+64c6, o2 = c1+4c3+16c5 */
+	krk_long_add(&e2, r2, rm2);
+	_div_exact_small(&e2, 2);
+	krk_long_sub(&o2, r2, rm2);
+	_div_exact_small(&o2, 4);
+
+	/* c4 = ((e2-c0-64c6)/4 - (e1-c0-c6))/3, c2 = e1-c0-c6-c4 */
+	krk_long_sub(&e1, &e1, c0);
+	krk_long_sub(&e1, &e1, c6);
+	krk_long_sub(&e2, &e2, c0);
+	_mul_small(&t, c6, 64);
+	krk_long_sub(&e2, &e2, &t);
+	_div_exact_small(&e2, 4);
+	krk_long_sub(&c4, &e2, &e1);
+	_div_exact_small(&c4, 3);
+	krk_long_sub(&c2, &e1, &c4);
+
+	/* rh = (rh - 64c0 - 16c2 - 4c4 - c6)/2 = 16c1+4c3+c5 */
+	_mul_small(&t, c0, 64);
+	krk_long_sub(rh, rh, &t);
+	_mul_small(&t, &c2, 16);
+	krk_long_sub(rh, rh, &t);
+	_mul_small(&t, &c4, 4);
+	krk_long_sub(rh, rh, &t);
+	krk_long_sub(rh, rh, c6);
+	_div_exact_small(rh, 2);
+
+	/* x = (o2-o1)/3 = c3+5c5, y = (16o1-rh)/3 = 4c3+5c5 */
+	krk_long_sub(&o2, &o2, &o1);
+	_div_exact_small(&o2, 3);
+	_mul_small(&t, &o1, 16);
+	krk_long_sub(&t, &t, rh);
+	_div_exact_small(&t, 3);
+	krk_long_sub(&c3, &t, &o2);
+	_div_exact_small(&c3, 3);
+	krk_long_sub(&c5, &o2, &c3);
+	_div_exact_small(&c5, 5);
+	krk_long_sub(&c1, &o1, &c3);
+	krk_long_sub(&c1, &c1, &c5);
+
+	krk_long_resize(res, width);
+	krk_long_zero(res);
+	_add_at(res, c0, 0);
+	_add_at(res, &c1, m);
+	_add_at(res, &c2, 2 * m);
+	_add_at(res, &c3, 3 * m);
+	_add_at(res, &c4, 4 * m);
+	_add_at(res, &c5, 5 * m);
+	_add_at(res, c6, 6 * m);
+	krk_long_trim(res);
+
+	krk_long_clear_many(&e1, &o1, &e2, &o2, &c1, &c2, &c3, &c4, &c5, &t, NULL);
+}
+
+/**
+ * Toom-4, evaluating at 0, 1, -1, 2, -2, 1/2, and infinity.
+ */
+static int _mul_toom4(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	size_t m = (a->width + 3) / 4;
+
+	KrkLong x[4], y[4];
+	for (int i = 0; i < 4; ++i) {
+		_view(&x[i], a, i * m, i == 3 ? (size_t)a->width : m);
+		_view(&y[i], b, i * m, i == 3 ? (size_t)b->width : m);
 	}
 
-	FINISH_OUTPUT(res);
+	KrkLong p1, pm1, p2, pm2, ph, q1, qm1, q2, qm2, qh;
+	KrkLong c0, r1, rm1, r2, rm2, rh, c6;
+	krk_long_init_many(&p1, &pm1, &p2, &pm2, &ph, &q1, &qm1, &q2, &qm2, &qh, NULL);
+	krk_long_init_many(&c0, &r1, &rm1, &r2, &rm2, &rh, &c6, NULL);
+
+	_toom4_eval(x, &p1, &pm1, &p2, &pm2, &ph);
+	_toom4_eval(y, &q1, &qm1, &q2, &qm2, &qh);
+
+	struct MulJob jobs[] = {
+		{ &c0, &x[0], &y[0] }, { &r1, &p1, &q1 }, { &rm1, &pm1, &qm1 }, { &r2, &p2, &q2 },
+		{ &rm2, &pm2, &qm2 }, { &rh, &ph, &qh }, { &c6, &x[3], &y[3] },
+	};
+	_products(jobs, 7);
+
+	krk_long_clear_many(&p1, &pm1, &p2, &pm2, &ph, &q1, &qm1, &q2, &qm2, &qh, NULL);
+
+	_toom4_interpolate(res, a->width + b->width, m, &c0, &r1, &rm1, &r2, &rm2, &rh, &c6);
+
+	krk_long_clear_many(&c0, &r1, &rm1, &r2, &rm2, &rh, &c6, NULL);
 	return 0;
 }
 
-static int _lshift_one(KrkLong * in) {
-	if (in->width == 0) {
-		return 0;
+/*
+ * Number-theoretic transform multiplication, for operands too wide for
+ * Toom-Cook to keep up. The magnitudes are cut into 32-bit coefficients
+ * and convolved modulo three primes of 29 to 31 bits, each with a
+ * power-of-two subgroup of order at least 2**26; the smallest,
+ * 7 * 2**26 + 1, sets the longest transform at 2**26 points. A product
+ * coefficient is a sum of at most 2**26 products of two coefficients,
+ * so it stays below 2**26 * (2**32 - 1)**2, which is less than the
+ * product of the three primes (about 2**90.4), and the Chinese remainder
+ * theorem recovers each one exactly. Everything is integer arithmetic on
+ * 32- and 64-bit words, the same for either digit size.
+ *
+ * The forward transform is decimation in frequency, leaving its output
+ * in bit-reversed order, and the inverse is decimation in time reading
+ * that order back, so neither needs a permutation pass. Residues are kept
+ * in normal form and twiddle factors in Montgomery form (R = 2**32), so
+ * each butterfly needs one reduction.
+ */
+#ifndef KRK_LONG_NTT_CUTOFF
+#define KRK_LONG_NTT_CUTOFF _CUTOFF(12000,6000)
+#endif
+#ifndef KRK_LONG_SQR_NTT_CUTOFF
+#define KRK_LONG_SQR_NTT_CUTOFF _CUTOFF(7000,3000)
+#endif
+
+/* The smallest power-of-two subgroup of the three primes bounds the transform length. */
+#define KRK_LONG_NTT_MAX_LOG 26
+
+static const uint32_t _ntt_primes[3][2] = {
+	{ 2013265921, 31 }, /* 15 * 2**27 + 1, and a generator */
+	{ 1811939329, 13 }, /* 27 * 2**26 + 1 */
+	{  469762049,  3 }, /*  7 * 2**26 + 1 */
+};
+
+/*
+ * Twiddle factors are cached per thread and per prime, growing to the
+ * longest transform seen. Entry [len + j] of each table is w**j, for w a
+ * primitive (2*len)-th root of unity (or its inverse), so the table for a
+ * transform of length n is the first n entries of any longer one.
+ */
+struct NttTable {
+	uint32_t * fwd;
+	uint32_t * inv;
+	size_t size;
+};
+
+static KRK_LONG_THREAD_LOCAL struct NttTable _ntt_tables[3];
+
+static void _ntt_release(void) {
+	for (int i = 0; i < 3; ++i) {
+		if (!_ntt_tables[i].size) continue;
+		_heap_free(_ntt_tables[i].fwd, sizeof(uint32_t) * _ntt_tables[i].size);
+		_heap_free(_ntt_tables[i].inv, sizeof(uint32_t) * _ntt_tables[i].size);
+		_ntt_tables[i].size = 0;
 	}
+}
 
-	size_t abs_width = in->width < 0 ? -in->width : in->width;
-	size_t out_width = abs_width;
+static uint32_t _ntt_pow(uint32_t b, uint64_t e, uint32_t p) {
+	uint64_t out = 1, x = b;
+	for (; e; e >>= 1, x = x * x % p) {
+		if (e & 1) out = out * x % p;
+	}
+	return out;
+}
+
+/**
+ * t * 2**-32 mod p, for t < p * 2**32; pinv is -p**-1 mod 2**32.
+ */
+static inline uint32_t _ntt_redc(uint64_t t, uint32_t p, uint32_t pinv) {
+	uint32_t m = (uint32_t)t * pinv;
+	uint32_t r = (t + (uint64_t)m * p) >> 32;
+	return r >= p ? r - p : r;
+}
+
+static uint32_t _ntt_pinv(uint32_t p) {
+	uint32_t inv = p;
+	for (int i = 0; i < 4; ++i) inv *= 2 - p * inv;
+	return 0 - inv;
+}
 
-	if (in->digits[abs_width-1] >> (DIGIT_SHIFT - 1)) {
-		out_width += 1;
+static const struct NttTable * _ntt_table(int which, size_t n) {
+	struct NttTable * table = &_ntt_tables[which];
+	if (table->size >= n) return table;
+
+	uint32_t p = _ntt_primes[which][0], g = _ntt_primes[which][1];
+	uint32_t pinv = _ntt_pinv(p);
+	uint32_t one = ((uint64_t)1 << 32) % p;
+
+	_pool_register();
+	uint32_t * fwd = _heap_alloc(sizeof(uint32_t) * n);
+	uint32_t * inv = _heap_alloc(sizeof(uint32_t) * n);
+	size_t start = 1;
+	if (table->size) {
+		memcpy(fwd, table->fwd, sizeof(uint32_t) * table->size);
+		memcpy(inv, table->inv, sizeof(uint32_t) * table->size);
+		start = table->size;
+		_heap_free(table->fwd, sizeof(uint32_t) * table->size);
+		_heap_free(table->inv, sizeof(uint32_t) * table->size);
 	}
 
-	krk_long_resize(in, out_width);
+	for (size_t len = start; len < n; len <<= 1) {
+		uint32_t w = _ntt_pow(g, (p - 1) / (2 * len), p);
+		/* Into Montgomery form */
+		uint32_t wf = ((uint64_t)w << 32) % p;
+		uint32_t wi = ((uint64_t)_ntt_pow(w, p - 2, p) << 32) % p;
+		fwd[len] = inv[len] = one;
+		for (size_t j = 1; j < len; ++j) {
+			fwd[len+j] = _ntt_redc((uint64_t)fwd[len+j-1] * wf, p, pinv);
+			inv[len+j] = _ntt_redc((uint64_t)inv[len+j-1] * wi, p, pinv);
+		}
+	}
 
-	int carry = 0;
+	table->fwd = fwd;
+	table->inv = inv;
+	table->size = n;
+	return table;
+}
 
-	for (size_t i = 0; i < abs_width; ++i) {
-		uint32_t digit = in->digits[i];
-		in->digits[i] = ((digit << 1) + carry) & DIGIT_MAX;
-		carry = (digit >> (DIGIT_SHIFT -1));
+/* One decimation-in-frequency stage of a block of 2*len residues. */
+static inline void _ntt_dif_block(uint32_t * a, size_t len, const uint32_t * w, uint32_t p, uint32_t pinv) {
+	for (size_t j = 0; j < len; ++j) {
+		uint32_t u = a[j], v = a[j+len];
+		uint32_t s = u + v;
+		a[j] = s >= p ? s - p : s;
+		a[j+len] = _ntt_redc((uint64_t)(u >= v ? u - v : u + p - v) * w[len+j], p, pinv);
 	}
+}
 
-	if (carry) {
-		in->digits[out_width-1] = 1;
+/* One decimation-in-time stage of a block of 2*len residues. */
+static inline void _ntt_dit_block(uint32_t * a, size_t len, const uint32_t * w, uint32_t p, uint32_t pinv) {
+	for (size_t j = 0; j < len; ++j) {
+		uint32_t u = a[j], v = _ntt_redc((uint64_t)a[j+len] * w[len+j], p, pinv);
+		uint32_t s = u + v;
+		a[j] = s >= p ? s - p : s;
+		a[j+len] = u >= v ? u - v : u + p - v;
+	}
+}
+
+static void _ntt_forward(uint32_t * a, size_t n, const uint32_t * w, uint32_t p, uint32_t pinv) {
+	for (size_t len = n / 2; len; len >>= 1) {
+		for (size_t i = 0; i < n; i += 2 * len) _ntt_dif_block(a + i, len, w, p, pinv);
 	}
+}
 
-	return 0;
+static void _ntt_inverse(uint32_t * a, size_t n, const uint32_t * w, uint32_t p, uint32_t pinv) {
+	for (size_t len = 1; len < n; len <<= 1) {
+		for (size_t i = 0; i < n; i += 2 * len) _ntt_dit_block(a + i, len, w, p, pinv);
+	}
 }
 
-static size_t _bits_in(const KrkLong * num) {
-	if (num->width == 0) return 0;
+/*
+ * After the first stage of a forward transform, and before the last
+ * stage of an inverse one, the two halves are independent transforms
+ * of half the length using the same twiddle table. On the thread pool,
+ * transforms split that way until they are down to KRK_LONG_NTT_GRAIN.
+ */
+#ifndef KRK_LONG_NTT_GRAIN
+#define KRK_LONG_NTT_GRAIN (1 << 16)
+#endif
 
-	size_t abs_width = num->width < 0 ? -num->width : num->width;
+struct NttPass {
+	uint32_t * a;
+	size_t n;
+	const uint32_t * w;
+	uint32_t p, pinv;
+	int inverse;
+};
 
-	/* Top bit in digits[abs_width-1] */
-	size_t c = 0;
-	uint32_t digit = num->digits[abs_width-1];
-	while (digit) {
-		c++;
-		digit >>= 1;
+static void _ntt_pass(void * arg) {
+	struct NttPass * pass = arg;
+	if (_fork_threads == 1 || pass->n <= KRK_LONG_NTT_GRAIN) {
+		if (pass->inverse) _ntt_inverse(pass->a, pass->n, pass->w, pass->p, pass->pinv);
+		else _ntt_forward(pass->a, pass->n, pass->w, pass->p, pass->pinv);
+		return;
 	}
 
-	return c + (abs_width-1) * DIGIT_SHIFT;
+	size_t len = pass->n / 2;
+	struct NttPass halves[2] = { *pass, *pass };
+	halves[0].n = halves[1].n = len;
+	halves[1].a += len;
+
+	if (!pass->inverse) _ntt_dif_block(pass->a, len, pass->w, pass->p, pass->pinv);
+	_fork_join(_ntt_pass, halves, sizeof(struct NttPass), 2);
+	if (pass->inverse) _ntt_dit_block(pass->a, len, pass->w, pass->p, pass->pinv);
 }
 
-static size_t _bit_is_set(const KrkLong * num, size_t bit) {
-	size_t abs_width = num->width < 0 ? -num->width : num->width;
-	size_t digit_offset = bit / DIGIT_SHIFT;
-	size_t digit_bit    = bit % DIGIT_SHIFT;
-	return !!(num->digits[digit_offset] & (1 << digit_bit));
+/**
+ * Cut the magnitude of x into 32-bit coefficients, returning how many.
+ */
+static size_t _ntt_split(uint32_t * out, const KrkLong * x) {
+	ddigit_t acc = 0;
+	int bits = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < (size_t)x->width; ++i) {
+		acc |= (ddigit_t)x->digits[i] << bits;
+		for (bits += DIGIT_SHIFT; bits >= 32; bits -= 32) {
+			out[count++] = (uint32_t)acc;
+			acc >>= 32;
+		}
+	}
+	if (bits) out[count++] = (uint32_t)acc;
+	return count;
 }
 
-static int _bit_set_zero(KrkLong * num, int val) {
-	if (num->width == 0) {
-		krk_long_clear(num);
-		krk_long_init_si(num, !!val);
-		return 0;
+static size_t _ntt_coefficients(size_t width) {
+	return (width * DIGIT_SHIFT + 31) / 32;
+}
+
+/**
+ * Whether a product of this many digits is within the longest transform.
+ */
+static int _ntt_fits(size_t width) {
+	return _ntt_coefficients(width) < ((size_t)1 << KRK_LONG_NTT_MAX_LOG);
+}
+
+/* The convolution modulo one of the primes, into r; t is scratch unless squaring. */
+struct NttPrime {
+	int which;
+	size_t n;
+	const struct NttTable * table;
+	uint32_t * r, * t;
+	const uint32_t * xc, * yc;
+	size_t cx, cy;
+};
+
+static void _ntt_prime(void * arg) {
+	struct NttPrime * job = arg;
+	size_t n = job->n;
+	uint32_t * r = job->r, * t = job->t;
+	uint32_t p = _ntt_primes[job->which][0];
+	uint32_t pinv = _ntt_pinv(p);
+
+	for (size_t i = 0; i < job->cx; ++i) r[i] = job->xc[i] % p;
+	memset(r + job->cx, 0, sizeof(uint32_t) * (n - job->cx));
+	if (job->yc) {
+		for (size_t i = 0; i < job->cy; ++i) t[i] = job->yc[i] % p;
+		memset(t + job->cy, 0, sizeof(uint32_t) * (n - job->cy));
+	}
+
+	struct NttPass passes[2] = { { r, n, job->table->fwd, p, pinv, 0 }, { t, n, job->table->fwd, p, pinv, 0 } };
+	_fork_join(_ntt_pass, passes, sizeof(struct NttPass), job->yc ? 2 : 1);
+
+	if (job->yc) {
+		for (size_t i = 0; i < n; ++i) r[i] = _ntt_redc((uint64_t)r[i] * t[i], p, pinv);
+	} else {
+		for (size_t i = 0; i < n; ++i) r[i] = _ntt_redc((uint64_t)r[i] * r[i], p, pinv);
+	}
+
+	struct NttPass inverse = { r, n, job->table->inv, p, pinv, 1 };
+	_ntt_pass(&inverse);
+
+	/* Undo the factor of n from the inverse and the 2**-32 from the pointwise products. */
+	uint32_t rr = ((uint64_t)1 << 32) % p;
+	uint32_t scale = (uint64_t)rr * rr % p * (p - (p - 1) / n) % p;
+	for (size_t i = 0; i < n; ++i) r[i] = _ntt_redc((uint64_t)r[i] * scale, p, pinv);
+}
+
+/**
+ * res = x * y, or x * x if y is NULL, for non-negative x and y.
+ * The three primes are independent, and run in parallel on the pool.
+ */
+static int _ntt_convolve(KrkLong * res, const KrkLong * x, const KrkLong * y) {
+	size_t cx = _ntt_coefficients(x->width);
+	size_t cy = y ? _ntt_coefficients(y->width) : cx;
+	size_t n = 1;
+	while (n < cx + cy) n <<= 1;
+
+	/*
+	 * Three residue vectors, scratch for the other operand (one per prime
+	 * when they run in parallel), then the raw coefficients.
+	 */
+	int lanes = _fork_threads > 1 ? 3 : 1;
+	size_t size = sizeof(uint32_t) * ((3 + lanes) * n + cx + cy);
+	uint32_t * buf = _heap_alloc(size);
+	uint32_t * r[3] = { buf, buf + n, buf + 2 * n };
+	uint32_t * xc = buf + (3 + lanes) * n;
+	uint32_t * yc = y ? xc + cx : xc;
+	cx = _ntt_split(xc, x);
+	if (y) cy = _ntt_split(yc, y);
+
+	/* Twiddle tables are per thread, so they are looked up here for every job. */
+	struct NttPrime jobs[3];
+	for (int k = 0; k < 3; ++k) {
+		jobs[k] = (struct NttPrime){ k, n, _ntt_table(k, n), r[k], buf + (3 + k % lanes) * n, xc, y ? yc : NULL, cx, cy };
 	}
+	_fork_join(_ntt_prime, jobs, sizeof(struct NttPrime), 3);
+
+	/*
+	 * Garner's recombination: v = r0 + p0 * ((r1 - r0) / p0 mod p1) is below
+	 * p0 * p1, and the coefficient is v + p0 * p1 * ((r2 - v) / (p0 * p1) mod p2).
+	 * Coefficients overlap in 32-bit columns c0, c1, c2 that carry upward.
+	 */
+	uint64_t p0 = _ntt_primes[0][0], p1 = _ntt_primes[1][0], p2 = _ntt_primes[2][0];
+	uint64_t p01 = p0 * p1;
+	uint64_t inv01 = _ntt_pow(p0 % p1, p1 - 2, p1);
+	uint64_t inv012 = _ntt_pow(p01 % p2, p2 - 2, p2);
+
+	size_t width = x->width + (y ? y->width : x->width);
+	krk_long_resize(res, width);
+	uint64_t c0 = 0, c1 = 0, c2 = 0;
+	ddigit_t acc = 0;
+	int bits = 0;
+	size_t d = 0;
+	for (size_t i = 0; i < n && d < width; ++i) {
+		uint64_t v = r[0][i] + p0 * ((r[1][i] + p1 - r[0][i] % p1) * inv01 % p1);
+		uint64_t u = (r[2][i] + p2 - v % p2) * inv012 % p2;
+		uint64_t lo = (p01 & 0xFFFFFFFF) * u;
+		uint64_t hi = (p01 >> 32) * u;
+		c0 += (v & 0xFFFFFFFF) + (lo & 0xFFFFFFFF);
+		c1 += (v >> 32) + (lo >> 32) + (hi & 0xFFFFFFFF);
+		c2 += hi >> 32;
+
+		acc |= (ddigit_t)(uint32_t)c0 << bits;
+		c0 = c1 + (c0 >> 32);
+		c1 = c2;
+		c2 = 0;
+		for (bits += 32; bits >= DIGIT_SHIFT && d < width; bits -= DIGIT_SHIFT) {
+			res->digits[d++] = acc & DIGIT_MAX;
+			acc >>= DIGIT_SHIFT;
+		}
+	}
+	if (d < width) res->digits[d++] = acc & DIGIT_MAX;
+	while (d < width) res->digits[d++] = 0;
+	krk_long_trim(res);
 
-	num->digits[0] = (num->digits[0] & ~1) | (!!val);
+	_heap_free(buf, size);
 	return 0;
 }
 
-static int krk_long_bit_set(KrkLong * num, size_t bit) {
-	size_t abs_width = num->width < 0 ? -num->width : num->width;
-	size_t digit_offset = bit / DIGIT_SHIFT;
-	size_t digit_bit    = bit % DIGIT_SHIFT;
+static int _mul_ntt(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	return _ntt_convolve(res, a, b);
+}
+
+static int _sqr_ntt(KrkLong * res, const KrkLong * a) {
+	return _ntt_convolve(res, a, NULL);
+}
+
+/**
+ * Operands of very different widths: slice the wider one into pieces
+ * as wide as the narrower one, so each partial product is balanced.
+ */
+static int _mul_unbalanced(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	KrkLong chunk, partial;
+	krk_long_init_si(&partial, 0);
+
+	krk_long_resize(res, a->width + b->width);
+	krk_long_zero(res);
+
+	for (size_t offset = 0; offset < (size_t)a->width; offset += b->width) {
+		_view(&chunk, a, offset, b->width);
+		krk_long_mul(&partial, &chunk, b);
+		_add_at(res, &partial, offset);
+	}
+
+	krk_long_trim(res);
+	krk_long_clear(&partial);
+	return 0;
+}
+
+static int _mul_abs(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	/* Work on non-negative views, with the wider operand first. */
+	KrkLong va, vb;
+	_view(&va, a, 0, a->width < 0 ? -a->width : a->width);
+	_view(&vb, b, 0, b->width < 0 ? -b->width : b->width);
+	const KrkLong * x = &va, * y = &vb;
+	if (x->width < y->width) {
+		x = &vb;
+		y = &va;
+	}
+
+	if (y->width == 0) {
+		krk_long_clear(res);
+		return 0;
+	}
+
+	if (y->width < KRK_LONG_KARATSUBA_CUTOFF) {
+		STAT_TIER(TIER_MUL_BASECASE);
+		return _mul_basecase(res, x, y);
+	}
+	if (y->width >= KRK_LONG_NTT_CUTOFF && _ntt_fits(x->width + y->width)) {
+		STAT_TIER(TIER_MUL_NTT);
+		return _mul_ntt(res, x, y);
+	}
+	if (x->width >= 2 * y->width) {
+		STAT_TIER(TIER_MUL_UNBALANCED);
+		return _mul_unbalanced(res, x, y);
+	}
+	if (y->width < KRK_LONG_TOOM3_CUTOFF) {
+		STAT_TIER(TIER_MUL_KARATSUBA);
+		return _mul_karatsuba(res, x, y);
+	}
+	if (y->width < KRK_LONG_TOOM4_CUTOFF) {
+		STAT_TIER(TIER_MUL_TOOM3);
+		return _mul_toom3(res, x, y);
+	}
+	STAT_TIER(TIER_MUL_TOOM4);
+	return _mul_toom4(res, x, y);
+}
+
+/**
+ * Schoolbook squaring: sum each cross product a[i]*a[j], i < j, once,
+ * then double the total and add the squares on the diagonal.
+ */
+static int _sqr_basecase(KrkLong * res, const KrkLong * a) {
+	size_t n = a->width;
+
+	krk_long_resize(res, 2 * n);
+	krk_long_zero(res);
+
+	for (size_t i = 0; i < n; ++i) {
+		ddigit_t a_digit = a->digits[i];
+		ddigit_t carry = 0;
+		for (size_t j = i + 1; j < n; ++j) {
+			ddigit_t tmp = carry + a_digit * a->digits[j] + res->digits[i+j];
+			carry = tmp >> DIGIT_SHIFT;
+			res->digits[i+j] = tmp & DIGIT_MAX;
+		}
+		res->digits[i + n] = carry;
+	}
+
+	ddigit_t carry = 0;
+	for (size_t i = 0; i < n; ++i) {
+		ddigit_t sq = (ddigit_t)a->digits[i] * a->digits[i];
+		ddigit_t lo = ((ddigit_t)res->digits[2*i] << 1) + (sq & DIGIT_MAX) + carry;
+		res->digits[2*i] = lo & DIGIT_MAX;
+		ddigit_t hi = ((ddigit_t)res->digits[2*i+1] << 1) + (sq >> DIGIT_SHIFT) + (lo >> DIGIT_SHIFT);
+		res->digits[2*i+1] = hi & DIGIT_MAX;
+		carry = hi >> DIGIT_SHIFT;
+	}
+
+	krk_long_trim(res);
+	return 0;
+}
+
+/**
+ * Karatsuba squaring: a^2 = a1^2*B^2m + ((a0+a1)^2 - a1^2 - a0^2)*B^m + a0^2
+ */
+static int _sqr_karatsuba(KrkLong * res, const KrkLong * a) {
+	size_t m = (a->width + 1) / 2;
+
+	KrkLong a0, a1;
+	_view(&a0, a, 0, m);
+	_view(&a1, a, m, a->width);
+
+	KrkLong z0, z1, z2, sa;
+	krk_long_init_many(&z0, &z1, &z2, &sa, NULL);
+
+	krk_long_add(&sa, &a0, &a1);
+	struct MulJob jobs[] = { { .out = &z0, .x = &a0 }, { .out = &z2, .x = &a1 }, { .out = &z1, .x = &sa } };
+	_products(jobs, 3);
+	krk_long_sub(&z1, &z1, &z0);
+	krk_long_sub(&z1, &z1, &z2);
+
+	krk_long_resize(res, 2 * a->width);
+	krk_long_zero(res);
+	_add_at(res, &z0, 0);
+	_add_at(res, &z1, m);
+	_add_at(res, &z2, 2 * m);
+	krk_long_trim(res);
+
+	krk_long_clear_many(&z0, &z1, &z2, &sa, NULL);
+	return 0;
+}
+
+static int _sqr_toom3(KrkLong * res, const KrkLong * a) {
+	size_t m = (a->width + 2) / 3;
+
+	KrkLong x[3];
+	for (int i = 0; i < 3; ++i) _view(&x[i], a, i * m, i == 2 ? (size_t)a->width : m);
+
+	KrkLong p1, pm1, pm2, r0, r1, rm1, rm2, rinf;
+	krk_long_init_many(&p1, &pm1, &pm2, &r0, &r1, &rm1, &rm2, &rinf, NULL);
+
+	_toom3_eval(x, &p1, &pm1, &pm2);
+
+	struct MulJob jobs[] = {
+		{ .out = &r0, .x = &x[0] }, { .out = &r1, .x = &p1 }, { .out = &rm1, .x = &pm1 },
+		{ .out = &rm2, .x = &pm2 }, { .out = &rinf, .x = &x[2] },
+	};
+	_products(jobs, 5);
+
+	_toom3_interpolate(res, 2 * a->width, m, &r0, &r1, &rm1, &rm2, &rinf);
+
+	krk_long_clear_many(&p1, &pm1, &pm2, &r0, &r1, &rm1, &rm2, &rinf, NULL);
+	return 0;
+}
+
+static int _sqr_toom4(KrkLong * res, const KrkLong * a) {
+	size_t m = (a->width + 3) / 4;
+
+	KrkLong x[4];
+	for (int i = 0; i < 4; ++i) _view(&x[i], a, i * m, i == 3 ? (size_t)a->width : m);
+
+	KrkLong p1, pm1, p2, pm2, ph;
+	KrkLong c0, r1, rm1, r2, rm2, rh, c6;
+	krk_long_init_many(&p1, &pm1, &p2, &pm2, &ph, NULL);
+	krk_long_init_many(&c0, &r1, &rm1, &r2, &rm2, &rh, &c6, NULL);
+
+	_toom4_eval(x, &p1, &pm1, &p2, &pm2, &ph);
+
+	struct MulJob jobs[] = {
+		{ .out = &c0, .x = &x[0] }, { .out = &r1, .x = &p1 }, { .out = &rm1, .x = &pm1 }, { .out = &r2, .x = &p2 },
+		{ .out = &rm2, .x = &pm2 }, { .out = &rh, .x = &ph }, { .out = &c6, .x = &x[3] },
+	};
+	_products(jobs, 7);
+
+	krk_long_clear_many(&p1, &pm1, &p2, &pm2, &ph, NULL);
+
+	_toom4_interpolate(res, 2 * a->width, m, &c0, &r1, &rm1, &r2, &rm2, &rh, &c6);
+
+	krk_long_clear_many(&c0, &r1, &rm1, &r2, &rm2, &rh, &c6, NULL);
+	return 0;
+}
+
+/**
+ * res = a * a. Always non-negative.
+ */
+static int krk_long_sqr(KrkLong * res, const KrkLong * a) {
+	STAT_CALL(STAT_SQR, _stat_width(a, NULL));
+	POOL_SCOPE();
+	PREP_OUTPUT1(res,a);
+
+	KrkLong x;
+	_view(&x, a, 0, a->width < 0 ? -a->width : a->width);
+
+	if (x.width == 0) {
+		krk_long_resize(res, 0);
+	} else if (x.width >= KRK_LONG_SQR_NTT_CUTOFF && _ntt_fits(2 * x.width)) {
+		STAT_TIER(TIER_SQR_NTT);
+		_sqr_ntt(res, &x);
+	} else if (x.width < KRK_LONG_SQR_KARATSUBA_CUTOFF) {
+		STAT_TIER(TIER_SQR_BASECASE);
+		_sqr_basecase(res, &x);
+	} else if (x.width < KRK_LONG_SQR_TOOM3_CUTOFF) {
+		STAT_TIER(TIER_SQR_KARATSUBA);
+		_sqr_karatsuba(res, &x);
+	} else if (x.width < KRK_LONG_SQR_TOOM4_CUTOFF) {
+		STAT_TIER(TIER_SQR_TOOM3);
+		_sqr_toom3(res, &x);
+	} else {
+		STAT_TIER(TIER_SQR_TOOM4);
+		_sqr_toom4(res, &x);
+	}
+
+	FINISH_OUTPUT(res);
+	return 0;
+}
+
+static int krk_long_mul(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_MUL, _stat_width(a, b));
+	POOL_SCOPE();
+	if (a == b) return krk_long_sqr(res,a);
+
+	PREP_OUTPUT(res,a,b);
+
+	if (a->width == 0) {
+		krk_long_clear(res);
+		krk_long_init_copy(res,a);
+		FINISH_OUTPUT(res);
+		return 0;
+	}
+
+	if (b->width == 0) {
+		krk_long_clear(res);
+		krk_long_init_copy(res,b);
+		FINISH_OUTPUT(res);
+		return 0;
+	}
+
+	if (_mul_abs(res,a,b)) {
+		FINISH_OUTPUT(res);
+		return 1;
+	}
+
+	if (a->width < 0 == b->width < 0) {
+		krk_long_set_sign(res,1);
+	} else {
+		krk_long_set_sign(res,-1);
+	}
+
+	FINISH_OUTPUT(res);
+	return 0;
+}
+
+static size_t _bits_in(const KrkLong * num) {
+	if (num->width == 0) return 0;
+
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+
+	/* Top bit in digits[abs_width-1] */
+	size_t c = 0;
+	digit_t digit = num->digits[abs_width-1];
+	while (digit) {
+		c++;
+		digit >>= 1;
+	}
+
+	return c + (abs_width-1) * DIGIT_SHIFT;
+}
+
+static size_t _bit_is_set(const KrkLong * num, size_t bit) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+	size_t digit_offset = bit / DIGIT_SHIFT;
+	size_t digit_bit    = bit % DIGIT_SHIFT;
+	return !!(num->digits[digit_offset] & ((digit_t)1 << digit_bit));
+}
+
+static int krk_long_bit_set(KrkLong * num, size_t bit) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+	size_t digit_offset = bit / DIGIT_SHIFT;
+	size_t digit_bit    = bit % DIGIT_SHIFT;
 
 	if (digit_offset >= abs_width) {
 		krk_long_resize(num, digit_offset+1);
@@ -462,298 +2478,1294 @@ static int krk_long_bit_set(KrkLong * num, size_t bit) {
 		}
 	}
 
-	num->digits[digit_offset] |= (1 << digit_bit);
+	num->digits[digit_offset] |= ((digit_t)1 << digit_bit);
+	return 0;
+}
+
+/*
+ * Shifts write over 'a' in place when 'res' is 'a': left shifts fill the
+ * output from the top down and right shifts from the bottom up, so every
+ * input digit is read before it is overwritten.
+ */
+static int krk_long_lshift(KrkLong * res, const KrkLong * a, size_t shift) {
+	STAT_CALL(STAT_LSHIFT, _stat_width(a, NULL));
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	size_t digit_offset = shift / DIGIT_SHIFT;
+	size_t digit_bit    = shift % DIGIT_SHIFT;
+	int sign = a->width < 0 ? -1 : 1;
+
+	if (awidth == 0) {
+		krk_long_resize(res, 0);
+		return 0;
+	}
+
+	krk_long_resize(res, awidth + digit_offset + 1);
+
+	res->digits[digit_offset + awidth] = digit_bit ? a->digits[awidth-1] >> (DIGIT_SHIFT - digit_bit) : 0;
+	for (size_t i = awidth - 1; i > 0; --i) {
+		digit_t low = digit_bit ? a->digits[i-1] >> (DIGIT_SHIFT - digit_bit) : 0;
+		res->digits[digit_offset + i] = ((a->digits[i] << digit_bit) | low) & DIGIT_MAX;
+	}
+	res->digits[digit_offset] = (a->digits[0] << digit_bit) & DIGIT_MAX;
+
+	for (size_t i = 0; i < digit_offset; ++i) {
+		res->digits[i] = 0;
+	}
+
+	krk_long_trim(res);
+	krk_long_set_sign(res, sign);
+	return 0;
+}
+
+/**
+ * Shifts right, rounding towards negative infinity like floor division.
+ */
+static int krk_long_rshift(KrkLong * res, const KrkLong * a, size_t shift) {
+	STAT_CALL(STAT_RSHIFT, _stat_width(a, NULL));
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	size_t digit_offset = shift / DIGIT_SHIFT;
+	size_t digit_bit    = shift % DIGIT_SHIFT;
+	int negative = a->width < 0;
+
+	if (digit_offset >= awidth) {
+		krk_long_resize(res, 0);
+		if (negative) {
+			krk_long_resize(res, -1);
+			res->digits[0] = 1;
+		}
+		return 0;
+	}
+
+	/* For negative values, any bits shifted out round the magnitude up. */
+	int lost = 0;
+	if (negative) {
+		for (size_t i = 0; i < digit_offset && !lost; ++i) {
+			lost = a->digits[i] != 0;
+		}
+		if (a->digits[digit_offset] & (((digit_t)1 << digit_bit) - 1)) lost = 1;
+	}
+
+	size_t owidth = awidth - digit_offset;
+	if (res != a) krk_long_resize(res, owidth);
+
+	for (size_t i = 0; i < owidth; ++i) {
+		digit_t next = (i + 1 < owidth) ? a->digits[digit_offset + i + 1] : 0;
+		digit_t high = digit_bit ? (next << (DIGIT_SHIFT - digit_bit)) : 0;
+		res->digits[i] = ((a->digits[digit_offset + i] >> digit_bit) | high) & DIGIT_MAX;
+	}
+
+	krk_long_resize(res, owidth);
+	krk_long_trim(res);
+
+	if (lost) {
+		KrkLong one;
+		krk_long_init_si(&one, 1);
+		krk_long_add(res, res, &one);
+		krk_long_clear(&one);
+	}
+
+	if (negative) krk_long_set_sign(res, -1);
+	return 0;
+}
+
+/**
+ * The main loop of Algorithm D. u holds the m+n digits of the normalized
+ * dividend plus a top digit for the bits shifted out, and v the n digits
+ * of the normalized divisor. Leaves the normalized remainder in the low
+ * n digits of u, and stores the m+1 quotient digits in q if it is set.
+ */
+static void _div_knuth_loop(digit_t * q, digit_t * u, size_t m, const digit_t * v, size_t n) {
+	for (size_t _j = 0; _j <= m; ++_j) {
+		size_t j = m - _j;
+
+		/* Estimate the quotient digit from the top two digits of the remainder. */
+		ddigit_t num  = ((ddigit_t)u[j+n] << DIGIT_SHIFT) | u[j+n-1];
+		digit_t r;
+		ddigit_t qhat = _div_wide(num, v[n-1], &r);
+		ddigit_t rhat = r;
+
+		while (qhat > DIGIT_MAX || qhat * v[n-2] > ((rhat << DIGIT_SHIFT) | u[j+n-2])) {
+			qhat--;
+			rhat += v[n-1];
+			if (rhat > DIGIT_MAX) break;
+		}
+
+		/* Multiply and subtract. */
+		ddigit_t carry = 0;
+		sddigit_t borrow = 0;
+		for (size_t i = 0; i < n; ++i) {
+			ddigit_t p = qhat * v[i] + carry;
+			carry = p >> DIGIT_SHIFT;
+			sddigit_t t = (sddigit_t)u[i+j] - borrow - (sddigit_t)(p & DIGIT_MAX);
+			u[i+j] = t & DIGIT_MAX;
+			borrow = t < 0;
+		}
+		sddigit_t t = (sddigit_t)u[j+n] - borrow - (sddigit_t)carry;
+		u[j+n] = t & DIGIT_MAX;
+
+		/* Estimate was one too large, add back. */
+		if (t < 0) {
+			qhat--;
+			digit_t c = 0;
+			for (size_t i = 0; i < n; ++i) {
+				digit_t sum = u[i+j] + v[i] + c;
+				u[i+j] = sum & DIGIT_MAX;
+				c = sum >> DIGIT_SHIFT;
+			}
+			u[j+n] = (u[j+n] + c) & DIGIT_MAX;
+		}
+
+		if (q) q[j] = qhat;
+	}
+}
+
+/**
+ * Knuth's Algorithm D (TAOCP vol. 2, 4.3.1): schoolbook long division
+ * producing one full digit of quotient per step.
+ * a and b are treated as magnitudes, with b at least two digits wide
+ * and a at least as wide as b.
+ */
+static int _div_knuth(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	size_t n = b->width < 0 ? -b->width : b->width;
+	size_t m = awidth - n;
+
+	/* Normalize so the top digit of the divisor has its high bit set. */
+	int s = 0;
+	while (!((b->digits[n-1] << s) & ((digit_t)1 << (DIGIT_SHIFT - 1)))) s++;
+
+	size_t vcap, ucap;
+	digit_t * v = _limb_alloc(n, &vcap);
+	digit_t * u = _limb_alloc(awidth + 1, &ucap);
+
+	for (size_t i = n - 1; i > 0; --i) {
+		v[i] = ((b->digits[i] << s) | (b->digits[i-1] >> (DIGIT_SHIFT - s))) & DIGIT_MAX;
+	}
+	v[0] = (b->digits[0] << s) & DIGIT_MAX;
+
+	u[awidth] = a->digits[awidth-1] >> (DIGIT_SHIFT - s);
+	for (size_t i = awidth - 1; i > 0; --i) {
+		u[i] = ((a->digits[i] << s) | (a->digits[i-1] >> (DIGIT_SHIFT - s))) & DIGIT_MAX;
+	}
+	u[0] = (a->digits[0] << s) & DIGIT_MAX;
+
+	krk_long_resize(quot, m + 1);
+	_div_knuth_loop(quot->digits, u, m, v, n);
+
+	/* Unnormalize the remainder. */
+	krk_long_resize(rem, n);
+	for (size_t i = 0; i < n - 1; ++i) {
+		rem->digits[i] = ((u[i] >> s) | (u[i+1] << (DIGIT_SHIFT - s))) & DIGIT_MAX;
+	}
+	rem->digits[n-1] = u[n-1] >> s;
+
+	krk_long_trim(quot);
+	krk_long_trim(rem);
+
+	_limb_free(u, ucap);
+	_limb_free(v, vcap);
+	return 0;
+}
+
+static int _div_abs(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
+	/* quot = a / b; rem = a % b */
+
+	/* Zero quotiant and remainder */
+	krk_long_clear(quot);
+	krk_long_clear(rem);
+
+	if (b->width == 0) return 1; /* div by zero */
+	if (a->width == 0) return 0; /* div of zero */
+
+	size_t awidth = a->width < 0 ? -a->width : a->width;
+	size_t bwidth = b->width < 0 ? -b->width : b->width;
+
+	if (bwidth == 1 && b->digits[0] == 1) {
+		krk_long_init_copy(quot, a);
+		krk_long_set_sign(quot, 1);
+		return 0;
+	}
+
+	if (awidth < bwidth) {
+		krk_long_init_copy(rem, a);
+		krk_long_set_sign(rem, 1);
+		return 0;
+	}
+
+	if (bwidth > 1) {
+		STAT_TIER(TIER_DIV_KNUTH);
+		return _div_knuth(quot, rem, a, b);
+	}
+
+	STAT_TIER(TIER_DIV_SMALL);
+
+	KrkLong absa;
+	krk_long_init_copy(&absa, a);
+	krk_long_set_sign(&absa, 1);
+
+	ddigit_t remainder = 0;
+	for (size_t i = 0; i < awidth; ++i) {
+		size_t _i = awidth - i - 1;
+		remainder = (remainder << DIGIT_SHIFT) | absa.digits[_i];
+		digit_t r;
+		absa.digits[_i] = _div_wide(remainder, b->digits[0], &r);
+		remainder = r;
+	}
+
+	krk_long_init_si(rem, remainder);
+	_swap(quot, &absa);
+	krk_long_trim(quot);
+
+	krk_long_clear(&absa);
+	return 0;
+}
+
+static int krk_long_div_rem(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_DIVMOD, _stat_width(a, b));
+	PREP_OUTPUT(quot,a,b);
+	PREP_OUTPUT(rem,a,b);
+	if (_div_abs(quot,rem,a,b)) {
+		FINISH_OUTPUT(rem);
+		FINISH_OUTPUT(quot);
+		return 1;
+	}
+
+	if ((a->width < 0) != (b->width < 0)) {
+		/* Round down if remainder */
+		if (rem->width) {
+			KrkLong one;
+			krk_long_init_si(&one, 1);
+			krk_long_add(quot, quot, &one);
+			_sub_big_small(rem, b, rem);
+			krk_long_clear(&one);
+		}
+
+		/* Signs are different, negate and round down if necessary */
+		krk_long_set_sign(quot, -1);
+	}
+
+	if (b->width < 0) {
+		krk_long_set_sign(rem, -1);
+	}
+
+	FINISH_OUTPUT(rem);
+	FINISH_OUTPUT(quot);
+	return 0;
+}
+
+static int krk_long_abs(KrkLong * out, const KrkLong * in) {
+	PREP_OUTPUT1(out,in);
+	krk_long_clear(out);
+	krk_long_init_copy(out, in);
+	krk_long_set_sign(out, 1);
+	FINISH_OUTPUT(out);
+	return 0;
+}
+
+static int krk_long_sign(const KrkLong * num) {
+	if (num->width == 0) return 0;
+	return num->width < 0 ? -1 : 1;
+}
+
+size_t krk_long_digits_in_base(KrkLong * num, int base) {
+	if (num->width == 0) return 1;
+
+	size_t bits = _bits_in(num);
+
+	if (base <  4)  return bits;
+	if (base <  8)  return (bits+1)/2;
+	if (base < 16)  return (bits+2)/3;
+	if (base == 16) return (bits+3)/4;
+	return 0;
+}
+
+digit_t krk_long_short(KrkLong * num) {
+	if (num->width == 0) return 0;
+	return num->digits[0];
+}
+
+/**
+ * The low 64 bits of the value, as two's complement.
+ */
+static int64_t krk_long_medium(const KrkLong * num) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+	uint64_t val = 0;
+	for (size_t i = 0, shift = 0; i < abs_width && shift < 64; ++i, shift += DIGIT_SHIFT) {
+		val |= (uint64_t)num->digits[i] << shift;
+	}
+	return num->width < 0 ? -val : val;
+}
+
+/**
+ * Store the value in 'out' if it fits in an int64_t. Returns 1, leaving
+ * 'out' untouched, if it does not.
+ */
+static int krk_long_get_int64(const KrkLong * num, int64_t * out) {
+	size_t bits = _bits_in(num);
+	if (bits > 64) return 1;
+	if (bits == 64) {
+		/* Only -2**63 needs all 64 bits. */
+		if (num->width > 0 || (uint64_t)krk_long_medium(num) != ((uint64_t)1 << 63)) return 1;
+	}
+	*out = krk_long_medium(num);
+	return 0;
+}
+
+/*
+ * Greatest common divisors use Lehmer's algorithm (TAOCP vol. 2, 4.5.2,
+ * Algorithm L): the quotients of several Euclidean steps are found from
+ * the leading digits alone and then applied to the full numbers as one
+ * linear combination. When the leading digits can't decide a quotient,
+ * a full division step is taken instead.
+ */
+
+/**
+ * The DIGIT_SHIFT bits of the magnitude of x starting at bit 'shift'.
+ */
+static digit_t _bits_at(const KrkLong * x, size_t shift) {
+	size_t width = x->width < 0 ? -x->width : x->width;
+	size_t offset = shift / DIGIT_SHIFT;
+	size_t bit    = shift % DIGIT_SHIFT;
+	if (offset >= width) return 0;
+	digit_t out = x->digits[offset] >> bit;
+	if (bit && offset + 1 < width) out |= x->digits[offset+1] << (DIGIT_SHIFT - bit);
+	return out & DIGIT_MAX;
+}
+
+/**
+ * out = p*x + q*y for single-digit p and q, using 'tmp' as scratch.
+ * Neither 'out' nor 'tmp' may alias x or y.
+ */
+static void _lincomb(KrkLong * out, KrkLong * tmp, const KrkLong * x, sddigit_t p, const KrkLong * y, sddigit_t q) {
+	_mul_small(out, x, p < 0 ? -p : p);
+	if (p < 0) out->width = -out->width;
+	_mul_small(tmp, y, q < 0 ? -q : q);
+	if (q < 0) tmp->width = -tmp->width;
+	krk_long_add(out, out, tmp);
+}
+
+/**
+ * x, y = A*x + B*y, C*x + D*y in place, for x >= y >= 0 and cofactors from
+ * the Lehmer inner loop, which make both results non-negative. Each
+ * result digit depends only on the digits below it, so one pass with
+ * signed carries updates both numbers.
+ */
+static void _lehmer_update(KrkLong * x, KrkLong * y, sddigit_t A, sddigit_t B, sddigit_t C, sddigit_t D) {
+	size_t n = x->width;
+	size_t ywidth = y->width;
+
+	krk_long_resize(y, n);
+	for (size_t i = ywidth; i < n; ++i) y->digits[i] = 0;
+
+	sddigit_t cx = 0, cy = 0;
+	for (size_t i = 0; i < n; ++i) {
+		sddigit_t xi = x->digits[i];
+		sddigit_t yi = y->digits[i];
+		cx += A * xi + B * yi;
+		cy += C * xi + D * yi;
+		x->digits[i] = cx & DIGIT_MAX;
+		y->digits[i] = cy & DIGIT_MAX;
+		cx >>= DIGIT_SHIFT;
+		cy >>= DIGIT_SHIFT;
+	}
+
+	krk_long_trim(x);
+	krk_long_trim(y);
+}
+
+/**
+ * g = gcd(a, b) for a >= b >= 0. If 't' is set, it receives the
+ * coefficient of b in g = s*a + t*b.
+ */
+static int _gcd_lehmer(KrkLong * g, KrkLong * t, const KrkLong * a, const KrkLong * b) {
+	KrkLong x, y, t0, t1, nx, ny, scratch;
+	krk_long_init_copy(&x, a);
+	krk_long_init_copy(&y, b);
+	krk_long_init_si(&t0, 0);
+	krk_long_init_si(&t1, 1);
+	krk_long_init_many(&nx, &ny, &scratch, NULL);
+
+	while (y.width) {
+		sddigit_t A = 1, B = 0, C = 0, D = 1;
+
+		if (y.width > 1) {
+			size_t shift = _bits_in(&x) - DIGIT_SHIFT;
+			sddigit_t xh = _bits_at(&x, shift);
+			sddigit_t yh = _bits_at(&y, shift);
+			while (yh + C != 0 && yh + D != 0) {
+				sddigit_t q = (xh + A) / (yh + C);
+				if (q != (xh + B) / (yh + D)) break;
+				sddigit_t tmp;
+				tmp = A - q * C;   A = C;   C = tmp;
+				tmp = B - q * D;   B = D;   D = tmp;
+				tmp = xh - q * yh; xh = yh; yh = tmp;
+			}
+		}
+
+		if (B == 0) {
+			/* x, y = y, x mod y */
+			krk_long_div_rem(&nx, &ny, &x, &y);
+			_swap(&x, &y);
+			_swap(&y, &ny);
+			if (t) {
+				krk_long_mul(&ny, &nx, &t1);
+				krk_long_sub(&ny, &t0, &ny);
+				_swap(&t0, &t1);
+				_swap(&t1, &ny);
+			}
+		} else {
+			_lehmer_update(&x, &y, A, B, C, D);
+			if (t) {
+				_lincomb(&nx, &scratch, &t0, A, &t1, B);
+				_lincomb(&ny, &scratch, &t0, C, &t1, D);
+				_swap(&t0, &nx);
+				_swap(&t1, &ny);
+			}
+		}
+	}
+
+	_swap(g, &x);
+	if (t) _swap(t, &t0);
+	krk_long_clear_many(&x, &y, &t0, &t1, &nx, &ny, &scratch, NULL);
+	return 0;
+}
+
+/**
+ * res = gcd(a, b), which is never negative.
+ */
+static int krk_long_gcd(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_GCD, _stat_width(a, b));
+	KrkLong x, y;
+	_view(&x, a, 0, a->width < 0 ? -a->width : a->width);
+	_view(&y, b, 0, b->width < 0 ? -b->width : b->width);
+	if (krk_long_compare_abs(&x, &y) < 0) {
+		KrkLong tmp = x;
+		x = y;
+		y = tmp;
+	}
+	return _gcd_lehmer(res, NULL, &x, &y);
+}
+
+/**
+ * res = gcd(a, b), with s and t set so that s*a + t*b == res.
+ */
+static int krk_long_xgcd(KrkLong * res, KrkLong * s, KrkLong * t, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_GCD, _stat_width(a, b));
+	int aneg = a->width < 0;
+	int bneg = b->width < 0;
+
+	KrkLong x, y;
+	_view(&x, a, 0, aneg ? -a->width : a->width);
+	_view(&y, b, 0, bneg ? -b->width : b->width);
+	int swapped = krk_long_compare_abs(&x, &y) < 0;
+	if (swapped) {
+		KrkLong tmp = x;
+		x = y;
+		y = tmp;
+	}
+
+	KrkLong g, u, v, tmp;
+	krk_long_init_many(&g, &u, &v, &tmp, NULL);
+
+	/* g = u*x + v*y; recover u from the others. */
+	_gcd_lehmer(&g, &v, &x, &y);
+	if (x.width) {
+		krk_long_mul(&tmp, &v, &y);
+		krk_long_sub(&tmp, &g, &tmp);
+		krk_long_div_rem(&u, &tmp, &tmp, &x);
+	}
+
+	if (swapped) _swap(&u, &v);
+	if (aneg) u.width = -u.width;
+	if (bneg) v.width = -v.width;
+
+	_swap(res, &g);
+	_swap(s, &u);
+	_swap(t, &v);
+	krk_long_clear_many(&g, &u, &v, &tmp, NULL);
+	return 0;
+}
+
+/**
+ * res = a**-1 mod m, taking the sign of m like the remainder from
+ * krk_long_div_rem. Returns 1 if m is zero or a has no inverse.
+ */
+static int krk_long_mod_inverse(KrkLong * res, const KrkLong * a, const KrkLong * m) {
+	if (m->width == 0) return 1;
+
+	KrkLong n, r, g, t, quot;
+	_view(&n, m, 0, m->width < 0 ? -m->width : m->width);
+	krk_long_init_many(&r, &g, &t, &quot, NULL);
+
+	krk_long_div_rem(&quot, &r, a, &n);
+	_gcd_lehmer(&g, &t, &n, &r);
+
+	int status = !(g.width == 1 && g.digits[0] == 1);
+	if (!status) {
+		krk_long_div_rem(&quot, &t, &t, m);
+		_swap(res, &t);
+	}
+
+	krk_long_clear_many(&r, &g, &t, &quot, NULL);
+	return status;
+}
+
+/*
+ * Exponentiation scans the exponent from the top in windows of up to a
+ * few bits that start and end on a set bit, so only odd powers of the
+ * base need to be precomputed. Each product is passed through a Reducer:
+ * none for plain powers, a prepared modulus (see struct KrkLongModulus)
+ * for even moduli, and Montgomery reduction for odd ones.
+ */
+struct Reducer {
+	int (*reduce)(KrkLong * x, const struct Reducer * r);
+	const KrkLong * mod;  /* Positive modulus */
+	digit_t ninv;         /* -mod**-1 mod 2**DIGIT_SHIFT, for Montgomery reduction */
+};
+
+/**
+ * -n**-1 mod 2**DIGIT_SHIFT for odd n. An odd n is its own inverse to three
+ * bits, and each Newton step doubles the number of correct bits.
+ */
+static digit_t _montgomery_inverse(digit_t n) {
+	digit_t inv = n;
+	for (int i = 0; i < 5; ++i) inv *= 2 - n * inv;
+	return (0 - inv) & DIGIT_MAX;
+}
+
+/**
+ * Montgomery reduction: x = x / 2**(DIGIT_SHIFT*k) mod n, for a k-digit odd
+ * n and 0 <= x < n * 2**(DIGIT_SHIFT*k). Each step adds the multiple of n
+ * that clears the lowest remaining digit, then the cleared digits are
+ * dropped.
+ */
+static int _reduce_montgomery(KrkLong * x, const struct Reducer * r) {
+	const KrkLong * n = r->mod;
+	size_t k = n->width;
+	size_t xwidth = x->width;
+
+	krk_long_resize(x, 2 * k + 1);
+	for (size_t i = xwidth; i < 2 * k + 1; ++i) x->digits[i] = 0;
+
+	for (size_t i = 0; i < k; ++i) {
+		digit_t u = (digit_t)(x->digits[i] * r->ninv) & DIGIT_MAX;
+		ddigit_t carry = 0;
+		for (size_t j = 0; j < k; ++j) {
+			ddigit_t tmp = (ddigit_t)u * n->digits[j] + x->digits[i+j] + carry;
+			x->digits[i+j] = tmp & DIGIT_MAX;
+			carry = tmp >> DIGIT_SHIFT;
+		}
+		for (size_t j = i + k; carry; ++j) {
+			ddigit_t tmp = x->digits[j] + carry;
+			x->digits[j] = tmp & DIGIT_MAX;
+			carry = tmp >> DIGIT_SHIFT;
+		}
+	}
+
+	memmove(x->digits, x->digits + k, sizeof(digit_t) * (k + 1));
+	krk_long_resize(x, k + 1);
+	krk_long_trim(x);
+	if (krk_long_compare_abs(x, n) >= 0) _sub_big_small(x, x, n);
+	return 0;
+}
+
+static int _pow_window_bits(size_t bits) {
+	if (bits < 24)  return 1;
+	if (bits < 80)  return 3;
+	if (bits < 240) return 4;
+	if (bits < 672) return 5;
+	return 6;
+}
+
+#define _REDUCE(x) do { if (r) r->reduce(x, r); } while (0)
+
+/**
+ * res = base ** exp, for exp > 0, passing every product through 'r' if
+ * it is set. 'res' must not alias the inputs.
+ */
+static int _pow_sliding(KrkLong * res, const KrkLong * base, const KrkLong * exp, const struct Reducer * r) {
+	size_t bits = _bits_in(exp);
+	int w = _pow_window_bits(bits);
+	size_t count = (size_t)1 << (w - 1);
+
+	/* table[i] = base ** (2*i+1) */
+	KrkLong table[32], sq;
+	krk_long_init_si(&sq, 0);
+	krk_long_init_copy(&table[0], base);
+	if (count > 1) {
+		krk_long_sqr(&sq, base);
+		_REDUCE(&sq);
+	}
+	for (size_t i = 1; i < count; ++i) {
+		krk_long_init_si(&table[i], 0);
+		krk_long_mul(&table[i], &table[i-1], &sq);
+		_REDUCE(&table[i]);
+	}
+
+	/* The top bit is set, so the first window initializes res. */
+	int first = 1;
+	ssize_t i = bits - 1;
+	while (i >= 0) {
+		if (!_bit_is_set(exp, i)) {
+			krk_long_sqr(res, res);
+			_REDUCE(res);
+			i--;
+			continue;
+		}
+
+		ssize_t j = i - w + 1 < 0 ? 0 : i - w + 1;
+		while (!_bit_is_set(exp, j)) j++;
+
+		size_t value = 0;
+		for (ssize_t k = i; k >= j; --k) value = (value << 1) | _bit_is_set(exp, k);
+
+		if (first) {
+			krk_long_set(res, &table[value >> 1]);
+			first = 0;
+		} else {
+			for (ssize_t k = i; k >= j; --k) {
+				krk_long_sqr(res, res);
+				_REDUCE(res);
+			}
+			krk_long_mul(res, res, &table[value >> 1]);
+			_REDUCE(res);
+		}
+		i = j - 1;
+	}
+
+	for (size_t i = 0; i < count; ++i) krk_long_clear(&table[i]);
+	krk_long_clear(&sq);
+	return 0;
+}
+
+#undef _REDUCE
+
+/**
+ * res = a ** b. Returns 1 if b is negative.
+ */
+static int krk_long_pow(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_POW, _stat_width(a, NULL));
+	if (b->width < 0) return 1;
+
+	KrkLong out;
+	krk_long_init_si(&out, b->width == 0);
+	if (b->width) _pow_sliding(&out, a, b, NULL);
+
+	_swap(res, &out);
+	krk_long_clear(&out);
+	return 0;
+}
+
+/**
+ * res = floor(sqrt(a)). Returns 1 if a is negative.
+ *
+ * This is the precision-doubling Newton iteration from CPython's
+ * math.isqrt: after each step, x is within one of the square root of
+ * the top 2*d+2 bits of a, and the last step covers all of them.
+ */
+static int krk_long_isqrt(KrkLong * res, const KrkLong * a) {
+	STAT_CALL(STAT_ROOT, _stat_width(a, NULL));
+	if (a->width < 0) return 1;
+	if (a->width == 0) {
+		krk_long_resize(res, 0);
+		return 0;
+	}
+
+	size_t c = (_bits_in(a) - 1) / 2;
+	int steps = 0;
+	while (c >> steps) steps++;
+
+	KrkLong x, t, q, r;
+	krk_long_init_si(&x, 1);
+	krk_long_init_many(&t, &q, &r, NULL);
+
+	size_t d = 0;
+	for (int s = steps - 1; s >= 0; --s) {
+		size_t e = d;
+		d = c >> s;
+		/* x = (x << (d - e - 1)) + (a >> (2*c - e - d + 1)) / x */
+		krk_long_rshift(&t, a, 2 * c - e - d + 1);
+		krk_long_div_rem(&q, &r, &t, &x);
+		krk_long_lshift(&x, &x, d - e - 1);
+		krk_long_add(&x, &x, &q);
+	}
+
+	krk_long_sqr(&t, &x);
+	if (krk_long_compare(&t, a) > 0) {
+		krk_long_clear(&t);
+		krk_long_init_si(&t, 1);
+		krk_long_sub(&x, &x, &t);
+	}
+
+	_swap(res, &x);
+	krk_long_clear_many(&x, &t, &q, &r, NULL);
 	return 0;
 }
 
-static int _div_abs(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
-	/* quot = a / b; rem = a % b */
+/**
+ * Remainder of the magnitude of num by a single digit.
+ */
+static digit_t _rem_small(const KrkLong * num, digit_t d) {
+	size_t abs_width = num->width < 0 ? -num->width : num->width;
+	digit_t rem = 0;
+	for (size_t i = abs_width; i-- > 0;) {
+		_div_wide(((ddigit_t)rem << DIGIT_SHIFT) | num->digits[i], d, &rem);
+	}
+	return rem;
+}
 
-	/* Zero quotiant and remainder */
-	krk_long_clear(quot);
-	krk_long_clear(rem);
+/**
+ * Whether a is a perfect square. Most non-squares are rejected by their
+ * residues modulo 64, 63, 5, 11 and 13 before any root is taken; each
+ * mask has a bit set for every square residue.
+ */
+static int krk_long_is_square(const KrkLong * a) {
+	if (a->width < 0) return 0;
+	if (a->width == 0) return 1;
+
+	if (!((0x202021202030213ULL >> (a->digits[0] & 63)) & 1)) return 0;
+
+	digit_t r = _rem_small(a, 63 * 5 * 11 * 13);
+	if (!((0x402483012450293ULL >> (r % 63)) & 1)) return 0;
+	if (!((0x13 >> (r % 5)) & 1)) return 0;
+	if (!((0x23b >> (r % 11)) & 1)) return 0;
+	if (!((0x161b >> (r % 13)) & 1)) return 0;
+
+	KrkLong root, sq;
+	krk_long_init_many(&root, &sq, NULL);
+	krk_long_isqrt(&root, a);
+	krk_long_sqr(&sq, &root);
+	int out = krk_long_compare(&sq, a) == 0;
+	krk_long_clear_many(&root, &sq, NULL);
+	return out;
+}
 
-	if (b->width == 0) return 1; /* div by zero */
-	if (a->width == 0) return 0; /* div of zero */
+/**
+ * res = floor(n ** (1/k)) for n > 0 and k >= 3. The root of n's top bits,
+ * found recursively, gives an overestimate correct to about half of the
+ * root's bits; Newton's method then descends onto the root from above in
+ * a step or two. Roots of at most 16 bits are built a bit at a time.
+ */
+static void _iroot_abs(KrkLong * res, const KrkLong * n, size_t k) {
+	size_t bits = _bits_in(n);
+	if (k >= bits) {
+		/* n < 2**k */
+		krk_long_clear(res);
+		krk_long_init_si(res, 1);
+		return;
+	}
 
-	size_t awidth = a->width < 0 ? -a->width : a->width;
-	size_t bwidth = b->width < 0 ? -b->width : b->width;
+	size_t rbits = (bits + k - 1) / k;
 
-	if (bwidth == 1 && b->digits[0] == 1) {
-		krk_long_init_copy(quot, a);
-		krk_long_set_sign(quot, 1);
-		return 0;
+	KrkLong x, t, q, r, ek;
+	krk_long_init_many(&x, &t, &q, &r, NULL);
+	krk_long_init_si(&ek, k);
+
+	if (rbits <= 16) {
+		digit_t root = 0;
+		for (size_t i = rbits; i-- > 0;) {
+			krk_long_init_si(&x, root | ((digit_t)1 << i));
+			krk_long_pow(&t, &x, &ek);
+			if (krk_long_compare(&t, n) <= 0) root |= (digit_t)1 << i;
+			krk_long_clear(&x);
+		}
+		krk_long_init_si(&x, root);
+	} else {
+		size_t s = rbits / 2;
+		krk_long_rshift(&t, n, k * s);
+		_iroot_abs(&x, &t, k);
+		krk_long_clear(&t);
+		krk_long_init_si(&t, 1);
+		krk_long_add(&x, &x, &t);
+		krk_long_lshift(&x, &x, s);
+
+		/* x = ((k-1)*x + n / x**(k-1)) / k, while that keeps going down */
+		KrkLong ekm1;
+		krk_long_init_si(&ekm1, k - 1);
+		for (;;) {
+			krk_long_pow(&t, &x, &ekm1);
+			krk_long_div_rem(&q, &r, n, &t);
+			_mul_small(&t, &x, k - 1);
+			krk_long_add(&t, &t, &q);
+			krk_long_div_rem(&q, &r, &t, &ek);
+			if (krk_long_compare(&q, &x) >= 0) break;
+			_swap(&x, &q);
+		}
+		krk_long_clear(&ekm1);
 	}
 
-	if (awidth < bwidth) {
-		krk_long_init_copy(rem, a);
-		krk_long_set_sign(rem, 1);
+	_swap(res, &x);
+	krk_long_clear_many(&x, &t, &q, &r, &ek, NULL);
+}
+
+/**
+ * res = the k-th root of a, rounded toward zero. Returns 1 if k is zero,
+ * or if k is even and a is negative.
+ */
+static int krk_long_iroot(KrkLong * res, const KrkLong * a, size_t k) {
+	STAT_CALL(STAT_ROOT, _stat_width(a, NULL));
+	if (k == 0 || (a->width < 0 && !(k & 1))) return 1;
+	if (k == 1) return krk_long_set(res, a);
+	if (k == 2) return krk_long_isqrt(res, a);
+	if (a->width == 0) {
+		krk_long_resize(res, 0);
 		return 0;
 	}
 
-	KrkLong absa, absb;
-	krk_long_init_copy(&absa, a);
-	krk_long_set_sign(&absa, 1);
-	krk_long_init_copy(&absb, b);
-	krk_long_set_sign(&absb, 1);
+	int negative = a->width < 0;
+	KrkLong n, out;
+	_view(&n, a, 0, negative ? -a->width : a->width);
+	krk_long_init_si(&out, 0);
+	_iroot_abs(&out, &n, k);
+	if (negative) krk_long_set_sign(&out, -1);
 
-	if (bwidth == 1) {
-		uint64_t remainder = 0;
-		for (size_t i = 0; i < awidth; ++i) {
-			size_t _i = awidth - i - 1;
-			remainder = (remainder << DIGIT_SHIFT) | absa.digits[_i];
-			absa.digits[_i] = (uint32_t)(remainder / absb.digits[0]) & DIGIT_MAX;
-			remainder -= (uint64_t)(absa.digits[_i]) * absb.digits[0];
-		}
+	_swap(res, &out);
+	krk_long_clear(&out);
+	return 0;
+}
 
-		krk_long_init_si(rem, remainder);
-		_swap(quot, &absa);
-		krk_long_trim(quot);
+/*
+ * Bitwise operations act on two's complement values, where a negative x
+ * is ~(|x| - 1). Writing A = |a| - 1 and B = |b| - 1 for negative
+ * operands, every combination of signs becomes one kernel over the
+ * magnitudes and at most a final increment:
+ *
+ *              &                 |                 ^
+ *   a, b >= 0  a & b             a | b             a ^ b
+ *   a >= 0 > b a & ~B            -((B & ~a) + 1)   -((a ^ B) + 1)
+ *   a, b < 0   -((A | B) + 1)    -((A & B) + 1)    A ^ B
+ *
+ * Only the overlapping digits go through the kernel. Past the narrower
+ * operand each result is either zero or a copy of the wider one, which
+ * sizes the output.
+ */
+static int do_bin_op(KrkLong * res, const KrkLong * a, const KrkLong * b, char op) {
+	/* All three are symmetric; put a negative operand second. */
+	if (a->width < 0 && b->width >= 0) {
+		const KrkLong * t = a;
+		a = b;
+		b = t;
+	}
 
-		krk_long_clear_many(&absa, &absb, NULL);
-		return 0;
+	int aneg = a->width < 0;
+	int bneg = b->width < 0;
+	size_t awidth = aneg ? -a->width : a->width;
+	size_t bwidth = bneg ? -b->width : b->width;
+	size_t overlap = awidth < bwidth ? awidth : bwidth;
+	size_t wider = awidth < bwidth ? bwidth : awidth;
+
+	int kernel, negate, flip = 0;
+	size_t width = wider;
+	if (!bneg) {
+		negate = 0;
+		kernel = op == '&' ? BITWISE_AND : op == '|' ? BITWISE_OR : BITWISE_XOR;
+		if (op == '&') width = overlap;
+	} else if (!aneg) {
+		negate = op != '&';
+		kernel = op == '^' ? BITWISE_XOR : BITWISE_ANDNOT;
+		if (op == '&') width = awidth;
+		if (op == '|') width = bwidth, flip = 1;
+	} else {
+		negate = op != '^';
+		kernel = op == '&' ? BITWISE_OR : op == '|' ? BITWISE_AND : BITWISE_XOR;
+		if (op == '|') width = overlap;
 	}
 
-	size_t bits = _bits_in(a);
-	for (size_t i = 0; i < bits; ++i) {
-		size_t _i = bits - i - 1;
+	size_t acap = 0, bcap = 0;
+	digit_t * adec = NULL, * bdec = NULL;
+	if (aneg) _sub_1(adec = _limb_alloc(awidth, &acap), a->digits, awidth, 1);
+	if (bneg) _sub_1(bdec = _limb_alloc(bwidth, &bcap), b->digits, bwidth, 1);
 
-		/* Shift remainder by one */
-		_lshift_one(rem);
+	/* res may be a or b, so their digits are fetched after it is resized. */
+	krk_long_resize(res, width + negate);
+	digit_t * r = res->digits;
+	const digit_t * x = aneg ? adec : a->digits;
+	const digit_t * y = bneg ? bdec : b->digits;
 
-		int is_set = _bit_is_set(&absa, _i);
-		_bit_set_zero(rem, is_set);
-		if (krk_long_compare(rem,&absb) >= 0) {
-			_sub_big_small(rem,rem,&absb);
-			krk_long_bit_set(quot, _i);
-		}
+	if (flip) _bitwise_n(kernel, r, y, x, overlap);
+	else _bitwise_n(kernel, r, x, y, overlap);
+
+	if (width > overlap) {
+		const digit_t * tail = awidth > bwidth ? x : y;
+		if (tail != r) memcpy(r + overlap, tail + overlap, sizeof(digit_t) * (width - overlap));
 	}
 
-	krk_long_trim(quot);
-	krk_long_clear_many(&absa,&absb,NULL);
+	if (negate) r[width] = _add_1(r, r, width, 1);
+
+	krk_long_trim(res);
+	if (negate) krk_long_set_sign(res, -1);
 
+	if (adec) _limb_free(adec, acap);
+	if (bdec) _limb_free(bdec, bcap);
 	return 0;
 }
 
-static int krk_long_div_rem(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(quot,a,b);
-	PREP_OUTPUT(rem,a,b);
-	if (_div_abs(quot,rem,a,b)) {
-		FINISH_OUTPUT(rem);
-		FINISH_OUTPUT(quot);
-		return 1;
-	}
+/* do_bin_op works one digit position at a time, so 'res' may alias either input. */
+static int krk_long_or(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_OR, _stat_width(a, b));
+	if (a->width == 0) return krk_long_set(res,b);
+	if (b->width == 0) return krk_long_set(res,a);
+	return do_bin_op(res,a,b,'|');
+}
 
-	if ((a->width < 0) != (b->width < 0)) {
-		/* Round down if remainder */
-		if (rem->width) {
-			KrkLong one;
-			krk_long_init_si(&one, 1);
-			krk_long_add(quot, quot, &one);
-			_sub_big_small(rem, b, rem);
-			krk_long_clear(&one);
-		}
+static int krk_long_xor(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_XOR, _stat_width(a, b));
+	return do_bin_op(res,a,b,'^');
+}
 
-		/* Signs are different, negate and round down if necessary */
-		krk_long_set_sign(quot, -1);
-	}
+static int krk_long_and(KrkLong * res, const KrkLong * a, const KrkLong * b) {
+	STAT_CALL(STAT_AND, _stat_width(a, b));
+	if (a->width == 0) return krk_long_set(res,a);
+	if (b->width == 0) return krk_long_set(res,b);
+	return do_bin_op(res,a,b,'&');
+}
 
-	if (b->width < 0) {
-		krk_long_set_sign(rem, -1);
-	}
+/*
+ * Radix conversion splits numbers by powers of the base; divisions by
+ * powers at least KRK_LONG_BARRETT_CUTOFF digits wide use a precomputed
+ * reciprocal instead of schoolbook division, and those reciprocals are
+ * found by Newton iteration above KRK_LONG_NEWTON_CUTOFF digits.
+ * Numbers at most KRK_LONG_STR_BASECASE digits wide are converted
+ * with repeated single-digit division, and strings of at most
+ * KRK_LONG_PARSE_BASECASE chunks are parsed with one multiply-add
+ * per chunk.
+ */
+#ifndef KRK_LONG_BARRETT_CUTOFF
+#define KRK_LONG_BARRETT_CUTOFF 150
+#endif
+#ifndef KRK_LONG_NEWTON_CUTOFF
+#define KRK_LONG_NEWTON_CUTOFF 150
+#endif
+#ifndef KRK_LONG_STR_BASECASE
+#define KRK_LONG_STR_BASECASE 32
+#endif
+#ifndef KRK_LONG_PARSE_BASECASE
+#define KRK_LONG_PARSE_BASECASE 32
+#endif
 
-	FINISH_OUTPUT(rem);
-	FINISH_OUTPUT(quot);
+/**
+ * res = B^count
+ */
+static int _power_of_radix(KrkLong * res, size_t count) {
+	krk_long_clear(res);
+	krk_long_resize(res, count + 1);
+	krk_long_zero(res);
+	res->digits[count] = 1;
 	return 0;
 }
 
-static int krk_long_abs(KrkLong * out, const KrkLong * in) {
-	PREP_OUTPUT1(out,in);
-	krk_long_clear(out);
-	krk_long_init_copy(out, in);
-	krk_long_set_sign(out, 1);
-	FINISH_OUTPUT(out);
-	return 0;
-}
+/**
+ * mu = floor(B^2w / d), for a positive d that is w digits wide.
+ */
+static int _reciprocal(KrkLong * mu, const KrkLong * d) {
+	size_t w = d->width;
+	KrkLong power, t;
+	krk_long_init_many(&power, &t, NULL);
+	_power_of_radix(&power, 2 * w);
+
+	if (w <= KRK_LONG_NEWTON_CUTOFF) {
+		krk_long_div_rem(mu, &t, &power, d);
+		krk_long_clear_many(&power, &t, NULL);
+		return 0;
+	}
 
-static int krk_long_sign(const KrkLong * num) {
-	if (num->width == 0) return 0;
-	return num->width < 0 ? -1 : 1;
+	/* Start from the reciprocal of the top half of d... */
+	size_t h = w / 2 + 1;
+	KrkLong dh, mh, x, e, v;
+	krk_long_init_many(&mh, &x, &e, NULL);
+	_view(&dh, d, w - h, h);
+	_reciprocal(&mh, &dh);
+	krk_long_lshift(&x, &mh, (w - h) * DIGIT_SHIFT);
+
+	/* ...refine it with one Newton step, x += x * (B^2w - d*x) / B^2w ... */
+	krk_long_mul(&t, d, &x);
+	krk_long_sub(&e, &power, &t);
+	krk_long_mul(&t, &x, &e);
+	_view(&v, &t, 2 * w, SIZE_MAX);
+	krk_long_clear(&e);
+	krk_long_init_copy(&e, &v);
+	krk_long_set_sign(&e, krk_long_sign(&t));
+	krk_long_add(&x, &x, &e);
+
+	/* ...and fix up the last few units with a short division. */
+	krk_long_mul(&t, d, &x);
+	krk_long_sub(&e, &power, &t);
+	krk_long_div_rem(&t, &e, &e, d);
+	krk_long_add(mu, &x, &t);
+
+	krk_long_clear_many(&power, &t, &mh, &x, &e, NULL);
+	return 0;
 }
 
-size_t krk_long_digits_in_base(KrkLong * num, int base) {
-	if (num->width == 0) return 1;
+/**
+ * Barrett division of a non-negative x < B^2w by a positive d that is
+ * w digits wide, given mu = floor(B^2w / d). The estimated quotient
+ * is at most two short, so no further division is needed.
+ */
+static int _div_barrett(KrkLong * quot, KrkLong * rem, const KrkLong * x, const KrkLong * d, const KrkLong * mu) {
+	STAT_TIER(TIER_DIV_BARRETT);
+	size_t w = d->width;
+	KrkLong t, q, one;
+	krk_long_init_many(&q, NULL);
+	krk_long_init_si(&one, 1);
+
+	_view(&t, x, w - 1, SIZE_MAX);
+	krk_long_mul(&q, &t, mu);
+	_view(&t, &q, w + 1, SIZE_MAX);
+	krk_long_clear(quot);
+	krk_long_init_copy(quot, &t);
 
-	size_t bits = _bits_in(num);
+	krk_long_mul(&q, quot, d);
+	krk_long_sub(rem, x, &q);
+	while (krk_long_compare(rem, d) >= 0) {
+		krk_long_sub(rem, rem, d);
+		krk_long_add(quot, quot, &one);
+	}
 
-	if (base <  4)  return bits;
-	if (base <  8)  return (bits+1)/2;
-	if (base < 16)  return (bits+2)/3;
-	if (base == 16) return (bits+3)/4;
+	krk_long_clear_many(&q, &one, NULL);
 	return 0;
 }
 
-uint32_t krk_long_short(KrkLong * num) {
-	if (num->width == 0) return 0;
-	return num->digits[0];
+/**
+ * Powers of a base used for divide-and-conquer radix conversion.
+ * powers[0] is the largest power of the base that fits in one digit
+ * (e.g. 10^9), and each further entry is the square of the previous,
+ * so powers[i] holds (chunk_digits << i) zeros when printed.
+ */
+#define KRK_LONG_RADIX_LEVELS 64
+
+struct RadixTable {
+	int base;
+	int chunk_digits;
+	size_t count;
+	KrkLong powers[KRK_LONG_RADIX_LEVELS];
+	KrkLong inverses[KRK_LONG_RADIX_LEVELS];
+};
+
+static void _radix_table_init(struct RadixTable * table, int base) {
+	digit_t chunk = base;
+	table->base = base;
+	table->chunk_digits = 1;
+	while ((ddigit_t)chunk * base <= DIGIT_MAX) {
+		chunk *= base;
+		table->chunk_digits++;
+	}
+
+	table->count = 1;
+	krk_long_init_si(&table->powers[0], chunk);
+	krk_long_init_si(&table->inverses[0], 0);
 }
 
-static int64_t krk_long_medium(KrkLong * num) {
-	if (num->width == 0) return 0;
+/**
+ * Append the next power. If 'square' is not set, the new entry is left
+ * as a zero placeholder, for when only its place in the table matters.
+ */
+static void _radix_table_grow(struct RadixTable * table, int square) {
+	krk_long_init_si(&table->powers[table->count], 0);
+	krk_long_init_si(&table->inverses[table->count], 0);
+	if (square) {
+		KrkLong * prev = &table->powers[table->count-1];
+		krk_long_mul(&table->powers[table->count], prev, prev);
+	}
+	table->count++;
+}
 
-	if (num->width < 0) {
-		uint64_t val = num->digits[0];
-		if (num->width < 1) {
-			val |= (num->digits[1]) << 31;
-		}
-		return -val;
-	} else {
-		uint64_t val = num->digits[0];
-		if (num->width > 1) {
-			val |= (num->digits[1]) << 31;
-		}
-		return val;
+static void _radix_table_clear(struct RadixTable * table) {
+	for (size_t i = 0; i < table->count; ++i) {
+		krk_long_clear_many(&table->powers[i], &table->inverses[i], NULL);
 	}
 }
 
-static int do_bin_op(KrkLong * res, const KrkLong * a, const KrkLong * b, char op) {
-	size_t awidth = a->width < 0 ? -a->width : a->width;
-	size_t bwidth = b->width < 0 ? -b->width : b->width;
-	size_t owidth = ((awidth > bwidth) ? awidth : bwidth) + 1;
+/**
+ * quot, rem = divmod(x, powers[level]), for x < powers[level]^2.
+ */
+static int _radix_divmod(struct RadixTable * table, size_t level, KrkLong * quot, KrkLong * rem, const KrkLong * x) {
+	const KrkLong * d = &table->powers[level];
+	if (d->width < KRK_LONG_BARRETT_CUTOFF) {
+		return krk_long_div_rem(quot, rem, x, d);
+	}
+	if (table->inverses[level].width == 0) {
+		_reciprocal(&table->inverses[level], d);
+	}
+	return _div_barrett(quot, rem, x, d, &table->inverses[level]);
+}
 
-	int aneg = (a->width < 0);
-	int bneg = (b->width < 0);
-	int rneg = 0;
+/**
+ * Write exactly len digits of a non-negative num, zero-padded,
+ * by repeatedly dividing by the one-digit chunk power.
+ */
+static void _to_str_basecase(struct RadixTable * table, const KrkLong * num, char * out, size_t len) {
+	static const char vals[] = "0123456789abcdef";
+	size_t width = num->width;
+	digit_t chunk = table->powers[0].digits[0];
+	size_t capacity;
+	digit_t * digits = _limb_alloc(width ? width : 1, &capacity);
+	for (size_t i = 0; i < width; ++i) digits[i] = num->digits[i];
+
+	char * writer = out + len;
+	while (writer > out) {
+		digit_t remainder = 0;
+		for (size_t i = 0; i < width; ++i) {
+			size_t _i = width - i - 1;
+			digits[_i] = _div_wide(((ddigit_t)remainder << DIGIT_SHIFT) | digits[_i], chunk, &remainder);
+		}
+		while (width && digits[width-1] == 0) width--;
 
-	switch (op) {
-		case '|': rneg = aneg | bneg; break;
-		case '^': rneg = aneg ^ bneg; break;
-		case '&': rneg = aneg & bneg; break;
+		for (int i = 0; i < table->chunk_digits && writer > out; ++i) {
+			*--writer = vals[remainder % table->base];
+			remainder /= table->base;
+		}
 	}
 
-	krk_long_resize(res, owidth);
+	_limb_free(digits, capacity);
+}
 
-	int acarry = aneg ? 1 : 0;
-	int bcarry = bneg ? 1 : 0;
-	int rcarry = rneg ? 1 : 0;
+/**
+ * Compute the Barrett reciprocals of every power that will be divided
+ * by up front, so threads sharing the table only ever read it.
+ */
+static void _radix_table_prepare(struct RadixTable * table) {
+	for (size_t level = 0; level + 1 < table->count; ++level) {
+		if (table->powers[level].width >= KRK_LONG_BARRETT_CUTOFF && table->inverses[level].width == 0) {
+			_reciprocal(&table->inverses[level], &table->powers[level]);
+		}
+	}
+}
 
-	for (size_t i = 0; i < owidth; ++i) {
-		uint32_t a_digit = (i < awidth ? a->digits[i] : 0);
-		a_digit = aneg ? ((a_digit ^ DIGIT_MAX) + acarry) : a_digit;
-		acarry = a_digit >> DIGIT_SHIFT;
+/* Either half of a number being converted; see _to_str_recurse. */
+struct StrJob {
+	struct RadixTable * table;
+	size_t level;
+	const KrkLong * num;
+	char * out;
+};
 
-		uint32_t b_digit = (i < bwidth ? b->digits[i] : 0);
-		b_digit = bneg ? ((b_digit ^ DIGIT_MAX) + bcarry) : b_digit;
-		bcarry = b_digit >> DIGIT_SHIFT;
+static void _to_str_job(void * arg);
 
-		uint32_t r;
-		switch (op) {
-			case '|': r = a_digit | b_digit; break;
-			case '^': r = a_digit ^ b_digit; break;
-			case '&': r = a_digit & b_digit; break;
-		}
+/**
+ * Write exactly (chunk_digits << level) digits of a non-negative
+ * num < powers[level], zero-padded, splitting by powers[level-1].
+ * Each half has a fixed place in the output, so on the thread pool
+ * the two are converted at once.
+ */
+static void _to_str_recurse(struct RadixTable * table, size_t level, const KrkLong * num, char * out) {
+	size_t len = (size_t)table->chunk_digits << level;
 
-		r = rneg ? (((r & DIGIT_MAX) ^ DIGIT_MAX) + rcarry) : r;
-		res->digits[i] = r & DIGIT_MAX;
-		rcarry = r >> DIGIT_SHIFT;
+	if (level == 0 || num->width <= KRK_LONG_STR_BASECASE) {
+		_to_str_basecase(table, num, out, len);
+		return;
 	}
 
-	krk_long_trim(res);
+	KrkLong hi, lo;
+	krk_long_init_many(&hi, &lo, NULL);
+	_radix_divmod(table, level - 1, &hi, &lo, num);
 
-	if (rneg) {
-		krk_long_set_sign(res,-1);
+	struct StrJob halves[] = { { table, level - 1, &hi, out }, { table, level - 1, &lo, out + len / 2 } };
+	if ((size_t)num->width >= _fork_cutoff()) {
+		_fork_join(_to_str_job, halves, sizeof(struct StrJob), 2);
+	} else {
+		_to_str_job(&halves[0]);
+		_to_str_job(&halves[1]);
 	}
 
-	return 0;
+	krk_long_clear_many(&hi, &lo, NULL);
 }
 
-static int krk_long_or(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
-	if (a->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,b);
-		FINISH_OUTPUT(res);
-		return 0;
-	} else if (b->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,a);
-		FINISH_OUTPUT(res);
-		return 0;
-	}
-
-	int out = do_bin_op(res,a,b,'|');
-	FINISH_OUTPUT(res);
-	return out;
+static void _to_str_job(void * arg) {
+	struct StrJob * job = arg;
+	_to_str_recurse(job->table, job->level, job->num, job->out);
 }
 
-static int krk_long_xor(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
-	int out = do_bin_op(res,a,b,'^');
-	FINISH_OUTPUT(res);
-	return out;
+/**
+ * Bits per output digit for power-of-two bases, or 0 for other bases.
+ */
+static int _radix_shift(int base) {
+	if (base & (base - 1)) return 0;
+	int shift = 0;
+	while ((1 << shift) < base) shift++;
+	return shift;
 }
 
-static int krk_long_and(KrkLong * res, const KrkLong * a, const KrkLong * b) {
-	PREP_OUTPUT(res,a,b);
-	if (a->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,a);
-		FINISH_OUTPUT(res);
-		return 0;
-	} else if (b->width == 0) {
-		krk_long_clear(res);
-		krk_long_init_copy(res,b);
-		FINISH_OUTPUT(res);
-		return 0;
+/**
+ * Write exactly len digits of a non-negative num in base (1 << shift),
+ * zero-padded, slicing bits straight out of the digit array.
+ */
+static void _to_str_pow2(const KrkLong * num, int shift, char * out, size_t len) {
+	static const char vals[] = "0123456789abcdef";
+	size_t width = num->width;
+	size_t next = 0;
+	ddigit_t acc = 0;
+	int acc_bits = 0;
+	digit_t mask = ((digit_t)1 << shift) - 1;
+
+	for (char * writer = out + len; writer > out;) {
+		if (acc_bits < shift && next < width) {
+			acc |= (ddigit_t)num->digits[next++] << acc_bits;
+			acc_bits += DIGIT_SHIFT;
+		}
+		*--writer = vals[acc & mask];
+		acc >>= shift;
+		acc_bits -= shift;
 	}
-
-	int out = do_bin_op(res,a,b,'&');
-	FINISH_OUTPUT(res);
-	return out;
 }
 
 char * krk_long_to_str(const KrkLong * n, int _base, const char * prefix, size_t *size) {
-	static const char vals[] = "0123456789abcdef";
-	KrkLong abs, mod, base;
-
-	krk_long_init_si(&abs, 0);
-	krk_long_init_si(&mod, 0);
-	krk_long_init_si(&base, _base);
-
-	krk_long_abs(&abs, n);
+	STAT_CALL(STAT_TO_STR, _stat_width(n, NULL));
+	POOL_SCOPE();
+	KrkLong abs;
+	_view(&abs, n, 0, SIZE_MAX);
 
 	int sign = krk_long_sign(n);   /* -? +? 0? */
+	size_t prefix_len = strlen(prefix);
 
-	size_t len = (sign == -1 ? 1 : 0) + krk_long_digits_in_base(&abs,_base) + strlen(prefix) + 1;
-	char * tmp = malloc(len);
-	char * writer = tmp;
+	struct RadixTable table;
+	size_t bits = _bits_in(&abs);
+	size_t digits;
+	int shift = _radix_shift(_base);
 
-	if (sign == 0) {
-		*writer++ = '0';
+	if (shift) {
+		digits = bits ? (bits + shift - 1) / shift : 1;
 	} else {
-		while (krk_long_sign(&abs) > 0) {
-			krk_long_div_rem(&abs,&mod,&abs,&base);
-			*writer++ = vals[krk_long_short(&mod)];
+		/*
+		 * Square until the last power exceeds the number. The last power is
+		 * never divided by, so when bit counts alone show the number is
+		 * below it, it is left as a placeholder instead of being computed.
+		 */
+		_radix_table_init(&table, _base);
+		while (krk_long_compare_abs(&table.powers[table.count-1], &abs) <= 0) {
+			int square = bits > 2 * _bits_in(&table.powers[table.count-1]) - 2;
+			_radix_table_grow(&table, square);
+			if (!square) break;
 		}
+		digits = (size_t)table.chunk_digits << (table.count - 1);
 	}
 
-	while (*prefix) { *writer++ = *prefix++; }
+	size_t len = (sign == -1 ? 1 : 0) + prefix_len + digits + 1;
+	char * out = malloc(len);
+	char * writer = out;
+
 	if (sign < 0) *writer++ = '-';
+	memcpy(writer, prefix, prefix_len);
+	writer += prefix_len;
 
-	char * rev = malloc(len);
-	char * out = rev;
-	while (writer != tmp) {
-		writer--;
-		*out++ = *writer;
+	if (shift) {
+		STAT_TIER(TIER_STR_POW2);
+		_to_str_pow2(&abs, shift, writer, digits);
+	} else {
+		STAT_TIER(TIER_STR_RECURSIVE);
+		if (_fork_threads > 1 && (size_t)abs.width >= _fork_cutoff()) _radix_table_prepare(&table);
+		_to_str_recurse(&table, table.count - 1, &abs, writer);
+		_radix_table_clear(&table);
 	}
-	*out = '\0';
 
-	free(tmp);
+	/* Strip the zero-padding, but leave one digit for zero. */
+	size_t skip = 0;
+	while (skip < digits - 1 && writer[skip] == '0') skip++;
+	memmove(writer, writer + skip, digits - skip);
+	writer[digits - skip] = '\0';
 
-	krk_long_clear_many(&abs,&mod,&base,NULL);
-	*size = strlen(rev);
-
-	return rev;
+	*size = (writer - out) + digits - skip;
+	return out;
 }
 
 static int is_valid(int base, char c) {
@@ -782,7 +3794,142 @@ static int convert_digit(char c) {
 	return 0;
 }
 
+/**
+ * num = num * mul + add, for a non-negative num already resized to
+ * hold the result; *used tracks how many of its digits are significant.
+ */
+static void _mul_add_small(KrkLong * num, size_t * used, digit_t mul, digit_t add) {
+	ddigit_t carry = add;
+	for (size_t i = 0; i < *used; ++i) {
+		ddigit_t tmp = (ddigit_t)num->digits[i] * mul + carry;
+		num->digits[i] = tmp & DIGIT_MAX;
+		carry = tmp >> DIGIT_SHIFT;
+	}
+	if (carry) {
+		num->digits[(*used)++] = carry;
+	}
+}
+
+/**
+ * Enough digits to hold any number of len digits in the table's base.
+ */
+static size_t _parse_width(struct RadixTable * table, size_t len) {
+	int bits_per_digit = 1;
+	while ((1 << bits_per_digit) < table->base) bits_per_digit++;
+	return (len * bits_per_digit) / DIGIT_SHIFT + 1;
+}
+
+/**
+ * Parse len digit values (not characters) by gathering a chunk of
+ * digits into a single word before each multiply-add.
+ */
+static void _parse_basecase(struct RadixTable * table, const unsigned char * digits, size_t len, KrkLong * num) {
+	krk_long_clear(num);
+	krk_long_resize(num, _parse_width(table, len));
+	krk_long_zero(num);
+
+	digit_t chunk = table->powers[0].digits[0];
+	size_t used = 0;
+	size_t first = len % table->chunk_digits;
+	if (!first) first = table->chunk_digits;
+
+	for (size_t i = 0; i < len; ) {
+		size_t count = i ? (size_t)table->chunk_digits : first;
+		digit_t word = 0, mul = 1;
+		for (size_t j = 0; j < count; ++j) {
+			word = word * table->base + digits[i+j];
+			mul *= table->base;
+		}
+		_mul_add_small(num, &used, i ? chunk : mul, word);
+		i += count;
+	}
+
+	krk_long_trim(num);
+}
+
+/* Either half of a string being parsed; see _parse_recurse. */
+struct ParseJob {
+	struct RadixTable * table;
+	const unsigned char * digits;
+	size_t len;
+	KrkLong * num;
+};
+
+static void _parse_job(void * arg);
+
+/**
+ * Parse len digit values as hi * powers[level] + lo, where lo
+ * is the trailing (chunk_digits << level) digits. On the thread pool
+ * the two halves are parsed at once, each into a number reserved to
+ * the widest it could be.
+ */
+static void _parse_recurse(struct RadixTable * table, const unsigned char * digits, size_t len, KrkLong * num) {
+	if (len <= (size_t)table->chunk_digits * KRK_LONG_PARSE_BASECASE) {
+		_parse_basecase(table, digits, len, num);
+		return;
+	}
+
+	size_t level = 0;
+	while (((size_t)table->chunk_digits << (level + 1)) < len) level++;
+	size_t lo_len = (size_t)table->chunk_digits << level;
+
+	KrkLong hi, lo;
+	krk_long_init_many(&hi, &lo, NULL);
+	if (_fork_threads > 1 && len / table->chunk_digits >= _fork_cutoff()) {
+		struct ParseJob halves[] = { { table, digits, len - lo_len, &hi }, { table, digits + len - lo_len, lo_len, &lo } };
+		krk_long_reserve(&hi, _parse_width(table, len - lo_len));
+		krk_long_reserve(&lo, _parse_width(table, lo_len));
+		_fork_join(_parse_job, halves, sizeof(struct ParseJob), 2);
+	} else {
+		_parse_recurse(table, digits, len - lo_len, &hi);
+		_parse_recurse(table, digits + len - lo_len, lo_len, &lo);
+	}
+	krk_long_mul(num, &hi, &table->powers[level]);
+	krk_long_add(num, num, &lo);
+	krk_long_clear_many(&hi, &lo, NULL);
+}
+
+static void _parse_job(void * arg) {
+	struct ParseJob * job = arg;
+	KrkLong tmp;
+	krk_long_init_si(&tmp, 0);
+	_parse_recurse(job->table, job->digits, job->len, &tmp);
+	_deliver(job->num, &tmp);
+}
+
+/**
+ * Parse len digit values in base (1 << shift) by packing their bits
+ * straight into the digit array, least significant first.
+ */
+static void _parse_pow2(const unsigned char * digits, size_t len, int shift, KrkLong * num) {
+	size_t width = (len * shift) / DIGIT_SHIFT + 1;
+	size_t out = 0;
+	ddigit_t acc = 0;
+	int acc_bits = 0;
+
+	krk_long_clear(num);
+	krk_long_resize(num, width);
+
+	for (size_t i = 0; i < len; ++i) {
+		acc |= (ddigit_t)digits[len - i - 1] << acc_bits;
+		acc_bits += shift;
+		if (acc_bits >= DIGIT_SHIFT) {
+			num->digits[out++] = acc & DIGIT_MAX;
+			acc >>= DIGIT_SHIFT;
+			acc_bits -= DIGIT_SHIFT;
+		}
+	}
+	while (out < width) {
+		num->digits[out++] = acc;
+		acc = 0;
+	}
+
+	krk_long_trim(num);
+}
+
 static int krk_long_parse_string(const char * str, KrkLong * num) {
+	STAT_CALL(STAT_PARSE, 0);
+	POOL_SCOPE();
 	const char * c = str;
 	int base = 10;
 	int sign = 1;
@@ -812,27 +3959,248 @@ static int krk_long_parse_string(const char * str, KrkLong * num) {
 
 	krk_long_init_si(num, 0);
 
-	KrkLong _base, scratch;
-	krk_long_init_si(&_base, base);
-	krk_long_init_si(&scratch, 0);
+	/* Collect digit values, dropping separators. */
+	size_t len = 0;
+	const char * end = c;
+	while (is_valid(base, *end)) end++;
+	unsigned char * digits = malloc((end - c) + 1);
+	for (; c < end; ++c) {
+		if (*c == '_') continue;
+		digits[len++] = convert_digit(*c);
+	}
 
-	while (is_valid(base, *c)) {
-		if (*c == '_') {
-			c++;
-			continue;
+	if (len && _radix_shift(base)) {
+		STAT_TIER(TIER_PARSE_POW2);
+		_parse_pow2(digits, len, _radix_shift(base), num);
+	} else if (len) {
+		STAT_TIER(TIER_PARSE_RECURSIVE);
+		struct RadixTable table;
+		_radix_table_init(&table, base);
+		while (((size_t)table.chunk_digits << table.count) < len) {
+			_radix_table_grow(&table, 1);
 		}
-		krk_long_mul(num, num, &_base);
-		krk_long_clear(&scratch);
-		krk_long_init_si(&scratch, convert_digit(*c));
-		krk_long_add(num, num, &scratch);
-		c++;
+		_parse_recurse(&table, digits, len, num);
+		_radix_table_clear(&table);
 	}
 
+	free(digits);
+
 	if (sign == -1) {
 		krk_long_set_sign(num, -1);
 	}
 
-	krk_long_clear_many(&_base, &scratch, NULL);
+	STAT_LIMBS(num->width < 0 ? -num->width : num->width);
+	return 0;
+}
+
+/*
+ * A modulus prepared for many reductions. Everything krk_long_div_rem
+ * would work out again on each call is kept: the divisor normalized for
+ * Algorithm D, the Barrett reciprocal for moduli of at least
+ * KRK_LONG_BARRETT_CUTOFF digits, and the Montgomery constant for odd
+ * ones. The scratch numbers keep their buffers from one call to the
+ * next, so a context must not be used from two threads at once, and it
+ * must not be moved once initialized.
+ */
+struct KrkLongModulus {
+	struct Reducer reducer;    /* Reduces by this context; must be first */
+	struct Reducer montgomery; /* For odd moduli */
+	KrkLong mod;               /* |m| */
+	KrkLong norm;              /* mod << shift, with the top bit set */
+	KrkLong mu;                /* floor(B**2w / mod) for wide moduli, otherwise zero */
+	KrkLong scratch[3];
+	int shift;
+	int negative;              /* Results take the sign of m */
+};
+
+/**
+ * x = |x| mod |m|. When x is at most twice as wide as a wide modulus,
+ * this is a Barrett reduction; otherwise it is the main loop of
+ * Algorithm D against the cached normalized divisor, without keeping
+ * the quotient.
+ */
+static void _modulus_rem(KrkLong * x, struct KrkLongModulus * M) {
+	size_t n = M->mod.width;
+	size_t xwidth = x->width < 0 ? -x->width : x->width;
+	krk_long_set_sign(x, 1);
+	if (krk_long_compare_abs(x, &M->mod) < 0) return;
+
+	if (n == 1) {
+		digit_t rem = _rem_small(x, M->mod.digits[0]);
+		krk_long_resize(x, 1);
+		x->digits[0] = rem;
+		krk_long_trim(x);
+		return;
+	}
+
+	if (M->mu.width && xwidth <= 2 * n) {
+		KrkLong t;
+		_view(&t, x, n - 1, SIZE_MAX);
+		krk_long_mul(&M->scratch[0], &t, &M->mu);
+		_view(&t, &M->scratch[0], n + 1, SIZE_MAX);
+		krk_long_mul(&M->scratch[1], &t, &M->mod);
+		krk_long_sub(x, x, &M->scratch[1]);
+		while (krk_long_compare(x, &M->mod) >= 0) krk_long_sub(x, x, &M->mod);
+		return;
+	}
+
+	int s = M->shift;
+	KrkLong * u = &M->scratch[0];
+	krk_long_resize(u, xwidth + 1);
+	u->digits[xwidth] = x->digits[xwidth-1] >> (DIGIT_SHIFT - s);
+	for (size_t i = xwidth - 1; i > 0; --i) {
+		u->digits[i] = ((x->digits[i] << s) | (x->digits[i-1] >> (DIGIT_SHIFT - s))) & DIGIT_MAX;
+	}
+	u->digits[0] = (x->digits[0] << s) & DIGIT_MAX;
+
+	_div_knuth_loop(NULL, u->digits, xwidth - n, M->norm.digits, n);
+
+	krk_long_resize(x, n);
+	for (size_t i = 0; i < n - 1; ++i) {
+		x->digits[i] = ((u->digits[i] >> s) | (u->digits[i+1] << (DIGIT_SHIFT - s))) & DIGIT_MAX;
+	}
+	x->digits[n-1] = u->digits[n-1] >> s;
+	krk_long_trim(x);
+}
+
+/**
+ * x = x mod |m|, in [0, |m|) whatever the sign of x.
+ */
+static void _modulus_residue(KrkLong * x, struct KrkLongModulus * M) {
+	int negative = x->width < 0;
+	_modulus_rem(x, M);
+	if (negative && x->width) krk_long_sub(x, &M->mod, x);
+}
+
+/**
+ * Move a residue into (m, 0] for a negative m, like krk_long_div_rem.
+ */
+static void _modulus_sign(KrkLong * x, struct KrkLongModulus * M) {
+	if (M->negative && x->width) krk_long_sub(x, x, &M->mod);
+}
+
+static int _reduce_modulus(KrkLong * x, const struct Reducer * r) {
+	_modulus_rem(x, (struct KrkLongModulus *)r);
+	return 0;
+}
+
+/**
+ * Prepare M for reductions by m. Returns 1 if m is zero.
+ */
+static int krk_long_modulus_init(struct KrkLongModulus * M, const KrkLong * m) {
+	if (m->width == 0) return 1;
+
+	krk_long_init_copy(&M->mod, m);
+	krk_long_set_sign(&M->mod, 1);
+	krk_long_init_many(&M->norm, &M->mu, &M->scratch[0], &M->scratch[1], &M->scratch[2], NULL);
+	M->negative = m->width < 0;
+
+	size_t n = M->mod.width;
+	M->shift = 0;
+	while (!((M->mod.digits[n-1] << M->shift) & ((digit_t)1 << (DIGIT_SHIFT - 1)))) M->shift++;
+	krk_long_lshift(&M->norm, &M->mod, M->shift);
+	if (n >= KRK_LONG_BARRETT_CUTOFF) _reciprocal(&M->mu, &M->mod);
+
+	M->reducer = (struct Reducer){ _reduce_modulus, &M->mod, 0 };
+	M->montgomery = (struct Reducer){ _reduce_montgomery, &M->mod, 0 };
+	if (M->mod.digits[0] & 1) M->montgomery.ninv = _montgomery_inverse(M->mod.digits[0]);
+	return 0;
+}
+
+static void krk_long_modulus_clear(struct KrkLongModulus * M) {
+	krk_long_clear_many(&M->mod, &M->norm, &M->mu, &M->scratch[0], &M->scratch[1], &M->scratch[2], NULL);
+}
+
+/**
+ * res = a mod m
+ */
+static int krk_long_modulus_reduce(KrkLong * res, const KrkLong * a, struct KrkLongModulus * M) {
+	STAT_CALL(STAT_MODULUS, _stat_width(a, NULL));
+	krk_long_set(res, a);
+	_modulus_residue(res, M);
+	_modulus_sign(res, M);
+	return 0;
+}
+
+/**
+ * res = a * b mod m. Operands already reduced by m take the Barrett
+ * path for wide moduli, as their product is less than m**2.
+ */
+static int krk_long_modulus_mul(KrkLong * res, const KrkLong * a, const KrkLong * b, struct KrkLongModulus * M) {
+	STAT_CALL(STAT_MODULUS, _stat_width(a, b));
+	KrkLong * t = &M->scratch[2];
+	krk_long_mul(t, a, b);
+	_modulus_residue(t, M);
+	_modulus_sign(t, M);
+	krk_long_set(res, t);
+	return 0;
+}
+
+/**
+ * res = a + b mod m. The sum of two reduced operands needs at most one
+ * subtraction.
+ */
+static int krk_long_modulus_add(KrkLong * res, const KrkLong * a, const KrkLong * b, struct KrkLongModulus * M) {
+	STAT_CALL(STAT_MODULUS, _stat_width(a, b));
+	KrkLong * t = &M->scratch[2];
+	krk_long_add(t, a, b);
+	if (t->width >= 0 && krk_long_compare(t, &M->mod) >= 0) krk_long_sub(t, t, &M->mod);
+	if (t->width < 0 || krk_long_compare(t, &M->mod) >= 0) _modulus_residue(t, M);
+	_modulus_sign(t, M);
+	krk_long_set(res, t);
+	return 0;
+}
+
+/**
+ * res = a ** b mod m. Negative exponents raise the inverse of a.
+ * Returns 1 if b is negative and a has no inverse.
+ */
+static int krk_long_modulus_pow(KrkLong * res, const KrkLong * a, const KrkLong * b, struct KrkLongModulus * M) {
+	STAT_CALL(STAT_POWMOD, _stat_width(a, NULL));
+	KrkLong e, base, out;
+	_view(&e, b, 0, b->width < 0 ? -b->width : b->width);
+	krk_long_init_many(&base, &out, NULL);
+
+	if (b->width >= 0) {
+		krk_long_set(&base, a);
+		_modulus_residue(&base, M);
+	} else if (krk_long_mod_inverse(&base, a, &M->mod)) {
+		krk_long_clear_many(&base, &out, NULL);
+		return 1;
+	}
+
+	if (e.width == 0) {
+		krk_long_clear(&out);
+		krk_long_init_si(&out, 1);
+		_modulus_rem(&out, M);
+	} else if (M->mod.digits[0] & 1) {
+		/* Into Montgomery form, base * 2**(DIGIT_SHIFT*k) mod n, and back out again. */
+		krk_long_lshift(&base, &base, M->mod.width * DIGIT_SHIFT);
+		_modulus_rem(&base, M);
+		_pow_sliding(&out, &base, &e, &M->montgomery);
+		_reduce_montgomery(&out, &M->montgomery);
+	} else {
+		_pow_sliding(&out, &base, &e, &M->reducer);
+	}
+	_modulus_sign(&out, M);
+
+	_swap(res, &out);
+	krk_long_clear_many(&base, &out, NULL);
+	return 0;
+}
+
+/**
+ * res = a ** b mod m, taking the sign of m like the remainder from
+ * krk_long_div_rem. Negative exponents raise the inverse of a. Returns 1
+ * if m is zero, or if b is negative and a has no inverse.
+ */
+static int krk_long_pow_mod(KrkLong * res, const KrkLong * a, const KrkLong * b, const KrkLong * m) {
+	STAT_CALL(STAT_POWMOD, _stat_width(a, NULL));
+	struct KrkLongModulus M;
+	if (krk_long_modulus_init(&M, m)) return 1;
+	int status = krk_long_modulus_pow(res, a, b, &M);
+	krk_long_modulus_clear(&M);
+	return status;
 }
 
 #ifndef AS_LIB
@@ -845,9 +4213,9 @@ static int krk_long_parse_string(const char * str, KrkLong * num) {
 	}
 
 PRINTER(str,10,"")
-PRINTER(hex,16,"x0")
-PRINTER(oct,8,"o0")
-PRINTER(bin,2,"b0")
+PRINTER(hex,16,"0x")
+PRINTER(oct,8,"0o")
+PRINTER(bin,2,"0b")
 
 static void verbose_operation(char * op, int (*func)(KrkLong*,const KrkLong*,const KrkLong*), KrkLong *c, const KrkLong *a, const KrkLong *b) {
 	print_base_str(stderr, a);
@@ -14,6 +14,7 @@ static KrkClass * _long;
 
 typedef KrkLong krk_long[1];
 
+/* Values up to KRK_LONG_INLINE_DIGITS digits wide live entirely within the instance. */
 struct BigInt {
 	KrkInstance inst;
 	krk_long value;
@@ -58,17 +59,25 @@ KRK_METHOD(long,__float__,{
 	})
 
 PRINTER(str,10,"")
-PRINTER(hex,16,"x0")
-PRINTER(oct,8,"o0")
-PRINTER(bin,2,"b0")
+PRINTER(hex,16,"0x")
+PRINTER(oct,8,"0o")
+PRINTER(bin,2,"0b")
 
 KRK_METHOD(long,__hash__,{
 	return INTEGER_VAL((uint32_t)(krk_long_medium(self->value)));
 })
 
+/* When set, operator results that fit in a native int are returned as one. */
+static int _demote = 0;
+
 static KrkValue make_long_obj(krk_long val) {
+	int64_t small;
+	if (_demote && !krk_long_get_int64(val, &small)) {
+		krk_long_clear(val);
+		return INTEGER_VAL(small);
+	}
 	krk_push(OBJECT_VAL(krk_newInstance(_long)));
-	*AS_long(krk_peek(0))->value = *val;
+	krk_long_move(AS_long(krk_peek(0))->value, val);
 	return krk_pop();
 }
 
@@ -76,21 +85,48 @@ KRK_METHOD(long,__int__,{
 	return INTEGER_VAL(krk_long_medium(self->value));
 })
 
+/*
+ * Operands are used without copying: long values are read in place, and
+ * native integers are unpacked into a KrkLong on the C stack, where they
+ * fit in the inline digits. Only the result is allocated.
+ */
+static const KrkLong * get_operand(KrkValue value, KrkLong * scratch) {
+	if (IS_long(value)) return AS_long(value)->value;
+	if (IS_INTEGER(value)) {
+		krk_long_init_si(scratch, AS_INTEGER(value));
+		return scratch;
+	}
+	return NULL;
+}
+
+static void release_operand(const KrkLong * operand, KrkLong * scratch) {
+	if (operand == scratch) krk_long_clear(scratch);
+}
+
+/*
+ * long is a value type: the in-place operators are bound to the same
+ * natives and return a new instance, leaving other references to the
+ * receiver, and its hash, unchanged.
+ */
 #define BASIC_BIN_OP(name, long_func) \
 	KRK_METHOD(long,__ ## name ## __,{ \
+		KrkLong scratch; \
+		const KrkLong * other = get_operand(argv[1], &scratch); \
+		if (!other) return NOTIMPL_VAL(); \
 		krk_long tmp; \
-		if (IS_long(argv[1])) krk_long_init_copy(tmp, AS_long(argv[1])->value); \
-		else if (IS_INTEGER(argv[1])) krk_long_init_si(tmp, AS_INTEGER(argv[1])); \
-		else return NOTIMPL_VAL(); \
-		long_func(tmp,self->value,tmp); \
+		krk_long_init_si(tmp, 0); \
+		long_func(tmp,self->value,other); \
+		release_operand(other, &scratch); \
 		return make_long_obj(tmp); \
 	}) \
 	KRK_METHOD(long,__r ## name ## __,{ \
+		KrkLong scratch; \
+		const KrkLong * other = get_operand(argv[1], &scratch); \
+		if (!other) return NOTIMPL_VAL(); \
 		krk_long tmp; \
-		if (IS_long(argv[1])) krk_long_init_copy(tmp, AS_long(argv[1])->value); \
-		else if (IS_INTEGER(argv[1])) krk_long_init_si(tmp, AS_INTEGER(argv[1])); \
-		else return NOTIMPL_VAL(); \
-		long_func(tmp,tmp,self->value); \
+		krk_long_init_si(tmp, 0); \
+		long_func(tmp,other,self->value); \
+		release_operand(other, &scratch); \
 		return make_long_obj(tmp); \
 	})
 
@@ -101,25 +137,23 @@ BASIC_BIN_OP(or, krk_long_or)
 BASIC_BIN_OP(xor,krk_long_xor)
 BASIC_BIN_OP(and,krk_long_and)
 
-static void _krk_long_lshift(krk_long out, krk_long val, krk_long shift) {
+static void _krk_long_lshift(KrkLong * out, const KrkLong * val, const KrkLong * shift) {
 	if (krk_long_sign(shift) < 0) { krk_runtimeError(vm.exceptions->valueError, "negative shift count"); return; }
-	krk_long multiplier;
-	krk_long_init_si(multiplier,0);
-	krk_long_bit_set(multiplier, krk_long_medium(shift));
-	krk_long_mul(out,val,multiplier);
-	krk_long_clear(multiplier);
+	/* Zero stays zero however far it is shifted; anything else would not fit in memory. */
+	if (_bits_in(shift) > 62) {
+		if (krk_long_sign(val) != 0) krk_runtimeError(vm.exceptions->overflowError, "too many digits in integer");
+		return;
+	}
+	krk_long_lshift(out,val,(size_t)krk_long_medium(shift));
 }
 
-static void _krk_long_rshift(krk_long out, krk_long val, krk_long shift) {
+static void _krk_long_rshift(KrkLong * out, const KrkLong * val, const KrkLong * shift) {
 	if (krk_long_sign(shift) < 0) { krk_runtimeError(vm.exceptions->valueError, "negative shift count"); return; }
-	krk_long multiplier, garbage;
-	krk_long_init_many(multiplier,garbage,NULL);
-	krk_long_bit_set(multiplier, krk_long_medium(shift));
-	krk_long_div_rem(out,garbage,val,multiplier);
-	krk_long_clear_many(multiplier,garbage,NULL);
+	/* Counts too wide for krk_long_medium shift everything out anyway. */
+	krk_long_rshift(out,val,_bits_in(shift) > 62 ? SIZE_MAX : (size_t)krk_long_medium(shift));
 }
 
-static void _krk_long_mod(krk_long out, krk_long a, krk_long b) {
+static void _krk_long_mod(KrkLong * out, const KrkLong * a, const KrkLong * b) {
 	if (krk_long_sign(b) == 0) { krk_runtimeError(vm.exceptions->valueError, "integer division or modulo by zero"); return; }
 	krk_long garbage;
 	krk_long_init_si(garbage,0);
@@ -127,7 +161,7 @@ static void _krk_long_mod(krk_long out, krk_long a, krk_long b) {
 	krk_long_clear(garbage);
 }
 
-static void _krk_long_div(krk_long out, krk_long a, krk_long b) {
+static void _krk_long_div(KrkLong * out, const KrkLong * a, const KrkLong * b) {
 	if (krk_long_sign(b) == 0) { krk_runtimeError(vm.exceptions->valueError, "integer division or modulo by zero"); return; }
 	krk_long garbage;
 	krk_long_init_si(garbage,0);
@@ -140,14 +174,56 @@ BASIC_BIN_OP(rshift,_krk_long_rshift)
 BASIC_BIN_OP(mod,_krk_long_mod)
 BASIC_BIN_OP(floordiv,_krk_long_div)
 
+static KrkValue long_pow(const KrkLong * base, const KrkLong * exp, const KrkLong * mod) {
+	if (mod && krk_long_sign(mod) == 0) return krk_runtimeError(vm.exceptions->valueError, "pow() 3rd argument cannot be 0");
+	if (!mod && krk_long_sign(exp) < 0) return krk_runtimeError(vm.exceptions->valueError, "negative exponents are not supported");
+	krk_long tmp;
+	krk_long_init_si(tmp, 0);
+	if (mod) {
+		if (krk_long_pow_mod(tmp, base, exp, mod)) {
+			krk_long_clear(tmp);
+			return krk_runtimeError(vm.exceptions->valueError, "base is not invertible for the given modulus");
+		}
+	} else {
+		krk_long_pow(tmp, base, exp);
+	}
+	return make_long_obj(tmp);
+}
+
+KRK_METHOD(long,__pow__,{
+	METHOD_TAKES_AT_LEAST(1);
+	METHOD_TAKES_AT_MOST(2);
+	KrkLong escratch, mscratch;
+	const KrkLong * exp = get_operand(argv[1], &escratch);
+	if (!exp) return NOTIMPL_VAL();
+	const KrkLong * mod = NULL;
+	if (argc > 2 && !IS_NONE(argv[2]) && !(mod = get_operand(argv[2], &mscratch))) {
+		release_operand(exp, &escratch);
+		return NOTIMPL_VAL();
+	}
+	KrkValue out = long_pow(self->value, exp, mod);
+	release_operand(exp, &escratch);
+	if (mod) release_operand(mod, &mscratch);
+	return out;
+})
+
+KRK_METHOD(long,__rpow__,{
+	METHOD_TAKES_EXACTLY(1);
+	KrkLong scratch;
+	const KrkLong * base = get_operand(argv[1], &scratch);
+	if (!base) return NOTIMPL_VAL();
+	KrkValue out = long_pow(base, self->value, NULL);
+	release_operand(base, &scratch);
+	return out;
+})
+
 #define COMPARE_OP(name, comp) \
 	KRK_METHOD(long,__ ## name ## __,{ \
-		krk_long tmp; \
-		if (IS_long(argv[1])) krk_long_init_copy(tmp, AS_long(argv[1])->value); \
-		else if (IS_INTEGER(argv[1])) krk_long_init_si(tmp, AS_INTEGER(argv[1])); \
-		else return NOTIMPL_VAL(); \
-		int cmp = krk_long_compare(self->value,tmp); \
-		krk_long_clear(tmp); \
+		KrkLong scratch; \
+		const KrkLong * other = get_operand(argv[1], &scratch); \
+		if (!other) return NOTIMPL_VAL(); \
+		int cmp = krk_long_compare(self->value,other); \
+		release_operand(other, &scratch); \
 		return BOOLEAN_VAL(cmp comp 0); \
 	})
 
@@ -164,6 +240,364 @@ KRK_METHOD(long,__len__,{
 	return INTEGER_VAL(krk_long_sign(self->value));
 })
 
+/* Route digit buffers through the VM allocator so the GC sees them. */
+static void * _long_alloc(size_t size) {
+	return krk_reallocate(NULL, 0, size);
+}
+
+static void _long_free(void * ptr, size_t size) {
+	krk_reallocate(ptr, size, 0);
+}
+
+static const struct KrkLongAllocator _long_allocator = { _long_alloc, _long_free };
+
+#define GET_OPERAND(name, value) \
+	KrkLong name ## _scratch; \
+	const KrkLong * name = get_operand(value, &name ## _scratch); \
+	if (!name) return TYPE_ERROR(int,value)
+
+/* gcd(a, b) */
+KRK_FUNC(gcd,{
+	FUNCTION_TAKES_EXACTLY(2);
+	GET_OPERAND(a, argv[0]);
+	GET_OPERAND(b, argv[1]);
+	krk_long out;
+	krk_long_init_si(out, 0);
+	krk_long_gcd(out, a, b);
+	release_operand(a, &a_scratch);
+	release_operand(b, &b_scratch);
+	return make_long_obj(out);
+})
+
+/* xgcd(a, b) -> (g, s, t) with s*a + t*b == g == gcd(a, b) */
+KRK_FUNC(xgcd,{
+	FUNCTION_TAKES_EXACTLY(2);
+	GET_OPERAND(a, argv[0]);
+	GET_OPERAND(b, argv[1]);
+	krk_long g, s, t;
+	krk_long_init_many(g, s, t, NULL);
+	krk_long_xgcd(g, s, t, a, b);
+	release_operand(a, &a_scratch);
+	release_operand(b, &b_scratch);
+	KrkTuple * out = krk_newTuple(3);
+	krk_push(OBJECT_VAL(out));
+	out->values.values[out->values.count++] = make_long_obj(g);
+	out->values.values[out->values.count++] = make_long_obj(s);
+	out->values.values[out->values.count++] = make_long_obj(t);
+	return krk_pop();
+})
+
+/* mod_inverse(a, m), the same as pow(a, -1, m) */
+KRK_FUNC(mod_inverse,{
+	FUNCTION_TAKES_EXACTLY(2);
+	GET_OPERAND(a, argv[0]);
+	GET_OPERAND(m, argv[1]);
+	if (krk_long_sign(m) == 0) {
+		release_operand(a, &a_scratch);
+		return krk_runtimeError(vm.exceptions->valueError, "integer division or modulo by zero");
+	}
+	krk_long out;
+	krk_long_init_si(out, 0);
+	int status = krk_long_mod_inverse(out, a, m);
+	release_operand(a, &a_scratch);
+	release_operand(m, &m_scratch);
+	if (status) return krk_runtimeError(vm.exceptions->valueError, "base is not invertible for the given modulus");
+	return make_long_obj(out);
+})
+
+/* isqrt(n), the integer square root */
+KRK_FUNC(isqrt,{
+	FUNCTION_TAKES_EXACTLY(1);
+	GET_OPERAND(n, argv[0]);
+	krk_long out;
+	krk_long_init_si(out, 0);
+	int status = krk_long_isqrt(out, n);
+	release_operand(n, &n_scratch);
+	if (status) return krk_runtimeError(vm.exceptions->valueError, "isqrt() argument must be nonnegative");
+	return make_long_obj(out);
+})
+
+/* iroot(n, k), the k-th root rounded toward zero */
+KRK_FUNC(iroot,{
+	FUNCTION_TAKES_EXACTLY(2);
+	if (!IS_INTEGER(argv[1])) return TYPE_ERROR(int,argv[1]);
+	krk_integer_type k = AS_INTEGER(argv[1]);
+	if (k <= 0) return krk_runtimeError(vm.exceptions->valueError, "iroot() degree must be positive");
+	GET_OPERAND(n, argv[0]);
+	krk_long out;
+	krk_long_init_si(out, 0);
+	int status = krk_long_iroot(out, n, k);
+	release_operand(n, &n_scratch);
+	if (status) return krk_runtimeError(vm.exceptions->valueError, "iroot() of a negative number with an even degree");
+	return make_long_obj(out);
+})
+
+/* is_square(n), whether n is a perfect square */
+KRK_FUNC(is_square,{
+	FUNCTION_TAKES_EXACTLY(1);
+	GET_OPERAND(n, argv[0]);
+	int out = krk_long_is_square(n);
+	release_operand(n, &n_scratch);
+	return BOOLEAN_VAL(out);
+})
+
+/*
+ * Modulus(m): a modulus prepared once for many reductions. Its methods
+ * accept ints or longs and return results with the sign of m, like %.
+ */
+static KrkClass * _modulus;
+
+struct Modulus {
+	KrkInstance inst;
+	struct KrkLongModulus ctx;
+	int ready;
+};
+
+static void _modulus_gcsweep(KrkInstance * self) {
+	struct Modulus * mod = (struct Modulus *)self;
+	if (mod->ready) krk_long_modulus_clear(&mod->ctx);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Modulus *
+
+/* Methods of an instance whose __init__ failed or never ran must not touch ctx. */
+#define MODULUS_READY() \
+	if (!self->ready) return krk_runtimeError(vm.exceptions->valueError, "Modulus is not initialized")
+
+/* A zero m is rejected before the old context is cleared, leaving it usable. */
+KRK_METHOD(modulus,__init__,{
+	METHOD_TAKES_EXACTLY(1);
+	GET_OPERAND(m, argv[1]);
+	if (krk_long_sign(m) == 0) {
+		release_operand(m, &m_scratch);
+		return krk_runtimeError(vm.exceptions->valueError, "integer division or modulo by zero");
+	}
+	if (self->ready) krk_long_modulus_clear(&self->ctx);
+	self->ready = !krk_long_modulus_init(&self->ctx, m);
+	release_operand(m, &m_scratch);
+	if (!self->ready) return krk_runtimeError(vm.exceptions->valueError, "integer division or modulo by zero");
+	return argv[0];
+})
+
+/* reduce(a), a % m */
+KRK_METHOD(modulus,reduce,{
+	METHOD_TAKES_EXACTLY(1);
+	MODULUS_READY();
+	GET_OPERAND(a, argv[1]);
+	krk_long out;
+	krk_long_init_si(out, 0);
+	krk_long_modulus_reduce(out, a, &self->ctx);
+	release_operand(a, &a_scratch);
+	return make_long_obj(out);
+})
+
+#define MODULUS_OP(name, long_func) \
+	KRK_METHOD(modulus,name,{ \
+		METHOD_TAKES_EXACTLY(2); \
+		MODULUS_READY(); \
+		GET_OPERAND(a, argv[1]); \
+		GET_OPERAND(b, argv[2]); \
+		krk_long out; \
+		krk_long_init_si(out, 0); \
+		long_func(out, a, b, &self->ctx); \
+		release_operand(a, &a_scratch); \
+		release_operand(b, &b_scratch); \
+		return make_long_obj(out); \
+	})
+
+/* mulmod(a, b), a * b % m */
+MODULUS_OP(mulmod, krk_long_modulus_mul)
+/* addmod(a, b), (a + b) % m */
+MODULUS_OP(addmod, krk_long_modulus_add)
+
+#undef MODULUS_OP
+
+/* powmod(a, e), the same as pow(a, e, m) */
+KRK_METHOD(modulus,powmod,{
+	METHOD_TAKES_EXACTLY(2);
+	MODULUS_READY();
+	GET_OPERAND(a, argv[1]);
+	GET_OPERAND(e, argv[2]);
+	krk_long out;
+	krk_long_init_si(out, 0);
+	int status = krk_long_modulus_pow(out, a, e, &self->ctx);
+	release_operand(a, &a_scratch);
+	release_operand(e, &e_scratch);
+	if (status) {
+		krk_long_clear(out);
+		return krk_runtimeError(vm.exceptions->valueError, "base is not invertible for the given modulus");
+	}
+	return make_long_obj(out);
+})
+
+#undef MODULUS_READY
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct BigInt *
+
+/* Digit buffer pool statistics for the calling thread. */
+KRK_FUNC(pool_stats,{
+	FUNCTION_TAKES_NONE();
+	struct KrkLongPoolStats stats;
+	krk_long_pool_stats(&stats);
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	krk_attachNamedValue(AS_DICT(dict), "hits", INTEGER_VAL(stats.hits));
+	krk_attachNamedValue(AS_DICT(dict), "misses", INTEGER_VAL(stats.misses));
+	krk_attachNamedValue(AS_DICT(dict), "returned", INTEGER_VAL(stats.returned));
+	krk_attachNamedValue(AS_DICT(dict), "released", INTEGER_VAL(stats.released));
+	krk_attachNamedValue(AS_DICT(dict), "cached", INTEGER_VAL(stats.cached));
+	return krk_pop();
+})
+
+/*
+ * Query, and optionally set, whether operators return native ints for
+ * results that fit in one. Returns the previous setting.
+ */
+KRK_FUNC(demote,{
+	FUNCTION_TAKES_AT_MOST(1);
+	int previous = _demote;
+	if (argc) {
+		if (!IS_BOOLEAN(argv[0])) return TYPE_ERROR(bool,argv[0]);
+		_demote = AS_BOOLEAN(argv[0]);
+	}
+	return BOOLEAN_VAL(previous);
+})
+
+/*
+ * Query, and optionally set, how many threads (counting the caller) very
+ * large multiplications may use; 1 keeps them on the calling thread.
+ * Returns the previous setting.
+ */
+KRK_FUNC(threads,{
+	FUNCTION_TAKES_AT_MOST(1);
+	int previous = krk_long_threads();
+	if (argc) {
+		if (!IS_INTEGER(argv[0])) return TYPE_ERROR(int,argv[0]);
+		if (AS_INTEGER(argv[0]) < 1) return krk_runtimeError(vm.exceptions->valueError, "thread count must be positive");
+		if (krk_long_set_threads(AS_INTEGER(argv[0]))) return krk_runtimeError(vm.exceptions->valueError, "could not start worker threads");
+	}
+	return INTEGER_VAL(previous);
+})
+
+/*
+ * Query, and optionally set, how many digits wide both operands of a
+ * multiplication step must be for its sub-products to be shared out
+ * between threads. Returns the previous setting.
+ */
+KRK_FUNC(parallel_cutoff,{
+	FUNCTION_TAKES_AT_MOST(1);
+	size_t previous = _fork_cutoff();
+	if (argc) {
+		if (!IS_INTEGER(argv[0])) return TYPE_ERROR(int,argv[0]);
+		if (AS_INTEGER(argv[0]) < 1) return krk_runtimeError(vm.exceptions->valueError, "cutoff must be positive");
+		previous = krk_long_set_parallel_cutoff(AS_INTEGER(argv[0]));
+	}
+	return INTEGER_VAL(previous);
+})
+
+/* Release the calling thread's cached digit buffers and NTT twiddle tables. */
+KRK_FUNC(pool_drain,{
+	FUNCTION_TAKES_NONE();
+	krk_long_pool_drain();
+})
+
+#ifdef KRK_LONG_STATS
+/* Names for the STAT_ and TIER_ counters, in the order bigint.c numbers them */
+static const char * krk_long_stat_operations[] = {
+	"add", "sub", "mul", "sqr", "divmod", "lshift", "rshift", "and", "or", "xor",
+	"pow", "modulus", "powmod", "gcd", "root", "to_str", "parse",
+};
+
+static const char * krk_long_stat_tiers[] = {
+	"mul_basecase", "mul_karatsuba", "mul_toom3", "mul_toom4", "mul_ntt", "mul_unbalanced",
+	"sqr_basecase", "sqr_karatsuba", "sqr_toom3", "sqr_toom4", "sqr_ntt",
+	"div_small", "div_knuth", "div_barrett",
+	"str_pow2", "str_recursive", "parse_pow2", "parse_recursive",
+	"fork",
+};
+
+/*
+ * Everything built here stays on the stack until it is stored, since
+ * attaching a value can allocate and so collect garbage.
+ */
+static void attach_top(KrkValue dict, const char * name) {
+	krk_attachNamedValue(AS_DICT(dict), name, krk_peek(0));
+	krk_pop();
+}
+
+/* Push a dict of one counter per name, as ints, or as seconds if scale is nonzero. */
+static void push_stats_table(const char ** names, const size_t * values, size_t count, double scale) {
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	for (size_t i = 0; i < count; ++i) {
+		krk_attachNamedValue(AS_DICT(dict), names[i], scale ? FLOATING_VAL(values[i] * scale) : INTEGER_VAL(values[i]));
+	}
+}
+
+/*
+ * Operation, algorithm and allocation counters, shared by all threads.
+ * 'histograms' maps each operation that has been called to rows of
+ * latency counts, one row per size bucket of under 10, 100, ... limbs,
+ * with columns of under 1us, 10us, ...
+ */
+KRK_FUNC(stats,{
+	FUNCTION_TAKES_NONE();
+	struct KrkLongStats stats;
+	krk_long_stats(&stats);
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	push_stats_table(krk_long_stat_operations, stats.calls, STAT_OPERATIONS, 0);
+	attach_top(dict, "calls");
+	push_stats_table(krk_long_stat_operations, stats.limbs, STAT_OPERATIONS, 0);
+	attach_top(dict, "limbs");
+	push_stats_table(krk_long_stat_operations, stats.nanoseconds, STAT_OPERATIONS, 1e-9);
+	attach_top(dict, "seconds");
+	push_stats_table(krk_long_stat_tiers, stats.tiers, STAT_TIERS, 0);
+	attach_top(dict, "tiers");
+	krk_attachNamedValue(AS_DICT(dict), "allocs", INTEGER_VAL(stats.allocs));
+	krk_attachNamedValue(AS_DICT(dict), "frees", INTEGER_VAL(stats.frees));
+	krk_attachNamedValue(AS_DICT(dict), "grows", INTEGER_VAL(stats.grows));
+	krk_attachNamedValue(AS_DICT(dict), "bytes_allocated", INTEGER_VAL(stats.bytes_allocated));
+	krk_attachNamedValue(AS_DICT(dict), "bytes_freed", INTEGER_VAL(stats.bytes_freed));
+
+	KrkValue histograms = krk_dict_of(0, NULL, 0);
+	krk_push(histograms);
+	for (int op = 0; op < STAT_OPERATIONS; ++op) {
+		if (!stats.calls[op]) continue;
+		KrkValue rows = krk_list_of(0, NULL, 0);
+		krk_push(rows);
+		for (int size = 0; size < KRK_LONG_STAT_SIZES; ++size) {
+			KrkValue row[KRK_LONG_STAT_LATENCIES];
+			for (int latency = 0; latency < KRK_LONG_STAT_LATENCIES; ++latency) {
+				row[latency] = INTEGER_VAL(stats.histogram[op][size][latency]);
+			}
+			krk_push(krk_list_of(KRK_LONG_STAT_LATENCIES, row, 0));
+			krk_writeValueArray(AS_LIST(rows), krk_peek(0));
+			krk_pop();
+		}
+		attach_top(histograms, krk_long_stat_operations[op]);
+	}
+	attach_top(dict, "histograms");
+	return krk_pop();
+})
+
+/* Zero the counters reported by stats(). */
+KRK_FUNC(reset_stats,{
+	FUNCTION_TAKES_NONE();
+	krk_long_reset_stats();
+})
+#else
+/* Statistics are only kept in builds with KRK_LONG_STATS; returns None. */
+KRK_FUNC(stats,{
+	FUNCTION_TAKES_NONE();
+})
+
+KRK_FUNC(reset_stats,{
+	FUNCTION_TAKES_NONE();
+})
+#endif
+
 #undef BIND_METHOD
 #define BIND_METHOD(klass,method) do { krk_defineNative(& _ ## klass->methods, #method, _ ## klass ## _ ## method); } while (0)
 KrkValue krk_module_onload_bigint(void) {
@@ -172,6 +606,22 @@ KrkValue krk_module_onload_bigint(void) {
 
 	KRK_DOC(module, "Very large integers.");
 
+	krk_long_set_allocator(&_long_allocator);
+	krk_attachNamedValue(&module->fields, "bits_per_digit", INTEGER_VAL(DIGIT_SHIFT));
+	BIND_FUNC(module,pool_stats);
+	BIND_FUNC(module,pool_drain);
+	BIND_FUNC(module,stats);
+	BIND_FUNC(module,reset_stats);
+	BIND_FUNC(module,demote);
+	BIND_FUNC(module,threads);
+	BIND_FUNC(module,parallel_cutoff);
+	BIND_FUNC(module,gcd);
+	BIND_FUNC(module,xgcd);
+	BIND_FUNC(module,mod_inverse);
+	BIND_FUNC(module,isqrt);
+	BIND_FUNC(module,iroot);
+	BIND_FUNC(module,is_square);
+
 	krk_makeClass(module, &_long, "long", vm.baseClasses->intClass);
 	_long->allocSize = sizeof(struct BigInt);
 	_long->_ongcsweep = _long_gcsweep;
@@ -204,6 +654,9 @@ KrkValue krk_module_onload_bigint(void) {
 	BIND_TRIPLET(floordiv);
 #undef BIND_TRIPLET
 
+	BIND_METHOD(long,__pow__);
+	BIND_METHOD(long,__rpow__);
+
 	BIND_METHOD(long,__lt__);
 	BIND_METHOD(long,__gt__);
 	BIND_METHOD(long,__le__);
@@ -211,6 +664,16 @@ KrkValue krk_module_onload_bigint(void) {
 
 	krk_finalizeClass(_long);
 
+	krk_makeClass(module, &_modulus, "Modulus", vm.baseClasses->objectClass);
+	_modulus->allocSize = sizeof(struct Modulus);
+	_modulus->_ongcsweep = _modulus_gcsweep;
+	BIND_METHOD(modulus,__init__);
+	BIND_METHOD(modulus,reduce);
+	BIND_METHOD(modulus,mulmod);
+	BIND_METHOD(modulus,addmod);
+	BIND_METHOD(modulus,powmod);
+	krk_finalizeClass(_modulus);
+
 	return krk_pop();
 }
 
@@ -32,6 +32,15 @@ def test(thing, operations=None, numbers=None, printers=None, shifts=None, shift
         str, hex, oct, bin
     ]
 
+    exponents = [
+        0, 1, 2, 7, 33
+    ]
+
+    moduli = [
+        7, -9, 1, 4096, 0, '0xfffffffffffffffffffffffffffffffb',
+        '-340282366920938463463374607431768211507', '-32932583298439028439285392'
+    ]
+
     for a in numbers:
         for printer in printers:
             print(printer.__name__,printer(thing(a)))
@@ -47,11 +56,215 @@ def test(thing, operations=None, numbers=None, printers=None, shifts=None, shift
                     print(a, opname, shift, '=', op(thing(a), shift))
                 except Exception as e:
                     print(a, opname, shift, '=', str(e))
+        for n in exponents:
+            print(a, '**', n, '=', thing(a) ** thing(n))
+        for m in moduli:
+            for n in exponents + numbers[7:9] + [-1, -3]:
+                try:
+                    print('pow', a, n, m, '=', pow(thing(a), thing(n), thing(m)))
+                except Exception as e:
+                    print('pow', a, n, m, '=', str(e))
+
+
+def test_gcd(thing, gcd, xgcd, mod_inverse):
+    numbers = [
+        0, 1, -6, 12, 1071, 462, '0x29589239862', '-30250320993256832943892058390285932532',
+        '29394294398256832432748937248937198578921421',
+        '864691128455135232000000000000000000000000000000', '-13835058055282163712000'
+    ]
+
+    for a in numbers:
+        for b in numbers:
+            print('gcd', a, b, '=', gcd(thing(a), thing(b)))
+            g, s, t = xgcd(thing(a), thing(b))
+            print('xgcd', a, b, '=', g, s * thing(a) + t * thing(b) == g)
+            if thing(b) != 0:
+                try:
+                    inverse = mod_inverse(thing(a), thing(b))
+                    print('inverse', a, b, '=', inverse, (inverse * thing(a) - 1) % thing(b) == 0)
+                except Exception as e:
+                    print('inverse', a, b, '=', str(e))
+    x = thing('29394294398256832432748937248937198578921421') ** 40
+    y = thing('-5392583232948329853251521') ** 30 * thing(1071)
+    print('gcd', hex(gcd(x * y, x * (y + 1))))
+
+
+def test_big(thing, bits_per_digit):
+    # Grow operands past the Karatsuba and Toom-Cook cutoffs, divide by
+    # multi-digit divisors, and print and parse with recursive splitting
+    x = thing('29394294398256832432748937248937198578921421')
+    y = thing('-5392583232948329853251521')
+    for i in range(7):
+        x = x * x + y
+        y = y * x - 1
+        z = x * y
+        print(i, hex(z))
+        print(i, str(z))
+        print(i, thing(str(z)) == z, thing(hex(z)) == z, thing(oct(z)) == z, thing(bin(z)) == z)
+        print(i, oct(z))
+        print(i, hex(z >> 1000), hex(z << 77))
+        print(i, hex(z // (x + 3)), hex(z % (x + 3)))
+        # Every sign combination, at equal and unequal widths
+        for a in (z, z * -1):
+            for b in (x, x * -1, z + x, (z + x) * -1):
+                print(i, hex(a & b), hex(a | b), hex(a ^ b))
+
+    # Carries and borrows that run the whole width, on both sides of the
+    # vector kernels' 16-digit minimum and with operands of unequal widths
+    for digits in [15, 16, 17, 23, 64, 131]:
+        ones = (thing(1) << (bits_per_digit * digits)) - 1
+        top = thing(1) << (bits_per_digit * digits)
+        short = (thing(1) << (bits_per_digit * (digits // 2) + 5)) - 1
+        print('carry', digits, hex(ones + 1), hex(thing(1) + ones), hex(ones + ones), hex(ones + short), hex(short + ones))
+        print('borrow', digits, hex(top - 1), hex(thing(1) - top), hex(top - short), hex(short - top), hex(ones - ones), hex((top + 1) - top))
+        print('compare', digits, ones < top, top > ones, ones == top - 1, ones + 1 == top, ones - 1 < ones, ones * -1 > top * -1,
+              top - 1 >= ones, top <= ones, short < ones, ones * -1 < short * -1)
+
+    # Augmented assignment rebinds the name; aliases and dict keys keep their value
+    a = x
+    b = a
+    d = {a: 'x'}
+    a += y
+    a *= a
+    a //= y
+    a >>= 1000
+    print('augmented', hex(a), b == x, a == b, x in d, d[b])
+
+    # Past the NTT cutoffs; the products are too long to print whole
+    x = thing(3) ** 500000 + y
+    z = x * (x + 12345)
+    print('ntt', z == x * x + x * 12345, z // x == x + 12345, hex(z % thing('0xfffffffffffffffffffffffffffffffb')))
+
+
+def test_roots(thing, isqrt, iroot, is_square):
+    numbers = [
+        0, 1, 2, 3, 4, 15, 16, 17, 1071, '0x29589239862', '30250320993256832943892058390285932532',
+        '864691128455135232000000000000000000000000000000'
+    ]
+
+    for a in numbers:
+        print('isqrt', a, '=', isqrt(thing(a)), is_square(thing(a)), is_square(thing(a) * thing(a)))
+        for k in [3, 5, 64]:
+            print('iroot', a, k, '=', iroot(thing(a), k), iroot(thing(a) ** k, k))
+    x = thing('29394294398256832432748937248937198578921421') ** 90 + 12345
+    print('isqrt', hex(isqrt(x)), is_square(x), is_square(x - 12345))
+    print('iroot', hex(iroot(x, 3)), hex(iroot(x, 7)), hex(iroot(x, 1000)))
+
+
+def test_modulus(thing, Modulus):
+    numbers = [
+        0, 1, -2, 12345, -987654321, '0x29589239862', '-30250320993256832943892058390285932532',
+        '29394294398256832432748937248937198578921421'
+    ]
+    moduli = [
+        7, -9, 1, 4096, '0xfffffffffffffffffffffffffffffffb', '-340282366920938463463374607431768211507'
+    ]
+
+    for m in moduli:
+        M = Modulus(thing(m))
+        for a in numbers:
+            r = M.reduce(thing(a))
+            print('mod', a, m, '=', r, M.powmod(thing(a), 65537), M.powmod(r, 3))
+            for b in numbers:
+                print('mod', a, b, m, '=', M.mulmod(thing(a), thing(b)), M.addmod(thing(a), thing(b)),
+                      M.mulmod(r, M.reduce(thing(b))), M.addmod(r, M.reduce(thing(b))))
+
+    # Wide enough for Barrett reduction
+    m = thing('29394294398256832432748937248937198578921421') ** 70 * 2 + 1
+    M = Modulus(m)
+    x = thing('-5392583232948329853251521') ** 100
+    y = M.reduce(x)
+    print('mod', hex(y), hex(M.mulmod(y, y)), hex(M.mulmod(x, x)), hex(M.addmod(y, m - 1)))
+    print('mod', hex(M.powmod(x, 1000)), hex(M.powmod(y, -1)))
+
+    # A failed re-init keeps the old modulus
+    M = Modulus(thing(7))
+    try:
+        M.__init__(thing(0))
+    except Exception as e:
+        print('mod', str(e))
+    print('mod', M.reduce(thing(10)), M.mulmod(thing(3), thing(5)), M.powmod(thing(3), 4))
+
+
+def test_threads(thing, threads, parallel_cutoff):
+    # The same products, and conversions to and from decimal, forked onto worker threads
+    previous, cutoff = threads(4), parallel_cutoff(50)
+    x = thing('29394294398256832432748937248937198578921421') ** 400 - 1
+    y = thing('-5392583232948329853251521') ** 700 + 1
+    print('threads', hex(x * y), hex(x * x), hex(y * y * y))
+    s = str(x * y)
+    print('threads', s[:40], s[-40:], len(s), thing(s) == x * y)
+    x = thing(3) ** 500000 - 1
+    z = x * (x + 12345)
+    print('threads', z == x * x + x * 12345, hex(z % thing('0xfffffffffffffffffffffffffffffffb')))
+    threads(previous)
+    parallel_cutoff(cutoff)
+
+
+def test_demote(thing, demote):
+    # Results that fit come back as native ints, which must print, compare
+    # and combine with longs just as longs would
+    previous = demote(True)
+    numbers = [
+        42, -53, 0, 1 << 40, '29394294398256832432748937248937198578921421', '-5392583232948329853251521'
+    ]
+    for a in numbers:
+        for b in numbers:
+            x, y = thing(a), thing(b)
+            print('demote', a, b, '=', x + y, x - y, x * y, x & y, x | y, x ^ y, (x + y) - y == x, (x * y) * x)
+            if y != 0:
+                print('demote', a, b, '=', x // y, x % y, (x * y) // y, (x // y) * y + x % y == x)
+    print('demote', thing(12345) ** 3, pow(thing(3), 100, thing(1000007)), (thing(1) << 100) >> 99, thing(7) << 3)
+    demote(previous)
 
 
 if __name__ == '__main__':
     if 'complex' in dir(__builtins__):
-        test(lambda a: int(a,0) if isinstance(a,str) else int(a))
+        import sys
+        if hasattr(sys, 'set_int_max_str_digits'):
+            sys.set_int_max_str_digits(0)
+        thing = lambda a: int(a,0) if isinstance(a,str) else int(a)
+        from math import gcd, isqrt
+        def xgcd(a, b):
+            s0, s1, t0, t1 = 1, 0, 0, 1
+            while b:
+                q = a // b
+                a, b = b, a - q * b
+                s0, s1 = s1, s0 - q * s1
+                t0, t1 = t1, t0 - q * t1
+            return (a, s0, t0) if a >= 0 else (-a, -s0, -t0)
+        mod_inverse = lambda a, m: pow(a, -1, m)
+        demote = lambda on=None: False
+        bits_per_digit = 63
+        is_square = lambda n: n >= 0 and isqrt(n) ** 2 == n
+        def iroot(n, k):
+            lo, hi = 0, 1 << -(-n.bit_length() // k)
+            while lo < hi:
+                mid = (lo + hi + 1) // 2
+                lo, hi = (mid, hi) if mid ** k <= n else (lo, mid - 1)
+            return lo
+        class Modulus:
+            def __init__(self, m):
+                if m == 0:
+                    raise ValueError('integer division or modulo by zero')
+                self.m = m
+            def reduce(self, a):
+                return a % self.m
+            def mulmod(self, a, b):
+                return a * b % self.m
+            def addmod(self, a, b):
+                return (a + b) % self.m
+            def powmod(self, a, e):
+                return pow(a, e, self.m)
+        threads = lambda n=None: 1
+        parallel_cutoff = lambda n=None: 0
     else:
-        from bigint import long
-        test(long)
+        from bigint import long, bits_per_digit, demote, gcd, xgcd, mod_inverse, isqrt, iroot, is_square, Modulus, threads, parallel_cutoff
+        thing = long
+    test(thing)
+    test_big(thing, bits_per_digit)
+    test_gcd(thing, gcd, xgcd, mod_inverse)
+    test_roots(thing, isqrt, iroot, is_square)
+    test_modulus(thing, Modulus)
+    test_threads(thing, threads, parallel_cutoff)
+    test_demote(thing, demote)